@@ -0,0 +1,78 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#ifndef P6_ASYNC_SIMULATION
+#define P6_ASYNC_SIMULATION
+
+#include "p6_construction.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace p6
+{
+	///Simulation running in background thread, created with Construction::simulate_async. Construction must not be accessed until simulation is finished
+	class AsyncSimulation
+	{
+	public:
+		///State of simulation
+		enum class Status
+		{
+			running,	///<Simulation is running
+			converged,	///<Simulation converged, construction is simulated
+			failed,		///<Simulation did not converge or threw
+			cancelled,	///<Simulation was cancelled
+			timed_out	///<Simulation exceeded deadline
+		};
+
+		///Progress of simulation
+		struct Progress
+		{
+			uint iteration = 0;			///<Number of finished Newton iterations of all load increments
+			uint increment = 0;			///<Index of current load increment
+			real load = 0.0;			///<Load factor of current load increment
+			real max_residual = 0.0;	///<Largest absolute residual after last iteration
+			real tolerance = 0.0;		///<Largest absolute residual considered as convergence
+		};
+
+	private:
+		friend class Construction;
+		Construction *_construction;					///<Simulated construction, not owned
+		bool _has_deadline;								///<Indicator if deadline is set
+		std::chrono::steady_clock::time_point _deadline;	///<Time after which simulation is stopped
+		std::atomic<bool> _cancel;						///<Indicator if cancellation is requested
+		mutable std::mutex _mutex;						///<Mutex protecting fields below
+		std::condition_variable _finish;				///<Signals that simulation is finished
+		Status _status = Status::running;				///<State of simulation
+		Progress _progress;								///<Progress of simulation
+		String _error;									///<Message of exception thrown by simulation
+		std::thread _thread;							///<Background thread
+
+		AsyncSimulation(Construction *construction, real timeout);	///<Starts simulation in background thread
+		void _run() noexcept;							///<Simulates construction and sets status
+		bool _stopped() const noexcept;					///<Returns if simulation has to stop, called by construction
+		void _update(const Construction::SimulationIteration *iteration, uint iterations, real tolerance) noexcept;	///<Updates progress, called by construction
+
+	public:
+		AsyncSimulation(const AsyncSimulation &) = delete;
+		AsyncSimulation &operator=(const AsyncSimulation &) = delete;
+		Status get_status() const noexcept;				///<Returns state of simulation
+		Progress get_progress() const noexcept;			///<Returns progress of simulation
+		String get_error() const;						///<Returns message of exception if simulation failed
+		void cancel() noexcept;							///<Requests cancellation, simulation stops after current Newton iteration and construction stays not simulated
+		bool wait_for(real seconds);					///<Waits until simulation finishes or time passes, returns if simulation finished
+		void wait();									///<Waits until simulation finishes
+		~AsyncSimulation() noexcept;					///<Cancels simulation and waits for it
+	};
+}
+
+#endif
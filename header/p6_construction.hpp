@@ -12,6 +12,9 @@
 #define P6_CONSTRUCTION
 
 #include "p6_material.hpp"
+#include <functional>
+#include <memory>
+#include <stdexcept>
 #include <vector>
 
 namespace p6
@@ -20,10 +23,131 @@ namespace p6
 	class DenseMatrix;	///<Dense matrix
 	class SparseMatrix;	///<Sparse matrix
 	class TripletVector;///<Vector of triplets
+	class ThreadPool;	///<Thread pool
+	class LinearSolver;	///<Solver of linear systems
+	class AsyncSimulation;	///<Simulation running in background thread
+
+	///Exception thrown if simulation does not converge
+	class ConvergenceError : public std::runtime_error
+	{
+	public:
+		ConvergenceError();	///<Creates exception with message "Simulation does not converge"
+	};
 
 	///Truss construction
 	class Construction
 	{
+	public:
+		///Solver of linear systems used in simulation
+		enum class Solver
+		{
+			lu,		///<Sparse LU with COLAMD ordering, works always
+			ldlt,	///<Simplicial LDLT with AMD ordering, falls back to LU if construction is not stable
+			llt,	///<Simplicial LLT with AMD ordering, falls back to LU if construction is not stable
+			cg,		///<Preconditioned conjugate gradients, requires stable construction
+			minres	///<Preconditioned minimal residual method
+		};
+
+		///Preconditioner of iterative solvers
+		enum class Preconditioner
+		{
+			jacobi,					///<Inverse diagonal
+			incomplete_cholesky,	///<Incomplete Cholesky factorization
+			amg						///<Smoothed aggregation algebraic multigrid
+		};
+
+		///Update of derivative between Newton iterations
+		enum class Update
+		{
+			newton,				///<Derivative is assembled and factorized every iteration
+			modified_newton,	///<Factorization is reused until convergence slows
+			bfgs				///<Factorization is reused with low-rank BFGS updates until convergence slows
+		};
+
+		///Globalization of Newton's method
+		enum class Globalization
+		{
+			line_search,	///<Step is halved until largest residual decreases
+			trust_region	///<Dogleg step inside trust region adapted to actual and predicted reductions of residual
+		};
+
+		///Scalar response of sensitivity analysis
+		enum class Response
+		{
+			compliance,			///<Work of forces on displacements of their nodes
+			node_displacement,	///<Displacement of node along direction
+			stick_force			///<Force of stick
+		};
+
+		///Force data
+		struct Force
+		{
+			uint node;
+			Coord direction;
+		};
+
+		///Results of several load cases, values of all nodes or sticks are stored case after case
+		struct LoadCaseResult
+		{
+			std::vector<unsigned char> converged;	///<Indicator if case converged, values of other cases are NaN
+			std::vector<Coord> displacement;		///<Displacements of nodes
+			std::vector<real> force;				///<Forces of sticks
+			std::vector<Coord> min_displacement;	///<Smallest displacement components of every node among converged cases
+			std::vector<Coord> max_displacement;	///<Largest displacement components of every node among converged cases
+			std::vector<real> min_force;			///<Smallest force of every stick among converged cases
+			std::vector<real> max_force;			///<Largest force of every stick among converged cases
+		};
+
+		///Stopping criteria and limits of Newton's method
+		struct SolverOptions
+		{
+			real absolute_tolerance = 0.0;	///<Largest absolute residual considered as convergence, zero means 0.001 of smallest force
+			real relative_tolerance = 0.0;	///<Largest residual relative to largest external load considered as convergence, used if larger than absolute tolerance
+			real step_tolerance = 0.0;		///<Iterations stop when largest step component is below this fraction of largest state component, zero means step has to vanish
+			uint max_iterations = 100;		///<Largest number of iterations per load increment, increment is halved if it is exceeded
+			uint max_halvings = 100;		///<Largest number of step halvings in line search or rejected steps in trust region
+			real correction_limit = 0.1;	///<Largest correction of node's coordinate as fraction of adjacent sticks' lengths, used by line search
+			bool early_exit = true;			///<Indicator if iterations stop as soon as residual is below tolerance
+			Update update = Update::newton;	///<Update of derivative between iterations, matrix-free mode always uses Newton's method
+			real refactorization_ratio = 0.5;	///<Derivative is refactorized if iteration decreases residual's norm less than by this factor
+			uint max_updates = 10;			///<Largest number of BFGS updates of one factorization
+			Globalization globalization = Globalization::line_search;	///<Globalization of iterations
+		};
+
+		///Iteration of Newton's method
+		struct SimulationIteration
+		{
+			uint increment = 0;				///<Index of load increment
+			real load = 0.0;				///<Load factor of increment
+			real max_residual = 0.0;		///<Largest absolute residual after iteration
+			unsigned int step_divider = 0;	///<Number of step halvings, accepted step is correction * 0.5^step_divider
+			bool factorized = false;		///<Indicator if derivative was assembled and factorized in iteration
+			real radius = 0.0;				///<Radius of trust region after iteration, zero with line search
+			real assembly_time = 0.0;		///<Time of assembly of derivative and residual in seconds
+			real factorization_time = 0.0;	///<Time of analysis and factorization in seconds
+			real solve_time = 0.0;			///<Time of linear solution in seconds
+			real line_search_time = 0.0;	///<Time of line search in seconds
+		};
+
+		///Report of last simulation, filled also if simulation does not converge
+		struct SimulationReport
+		{
+			bool converged = false;					///<Indicator if simulation converged
+			real tolerance = 0.0;					///<Largest absolute residual considered as convergence, larger of absolute and relative tolerances
+			std::vector<real> increment_load;		///<Load factors of attempted load increments
+			std::vector<unsigned char> increment_converged;	///<Indicator if load increment converged
+			std::vector<SimulationIteration> iteration;	///<Newton iterations of all increments
+			real assembly_time = 0.0;				///<Total time of assembly in seconds
+			real factorization_time = 0.0;			///<Total time of analysis and factorization in seconds
+			real solve_time = 0.0;					///<Total time of linear solutions in seconds
+			real line_search_time = 0.0;			///<Total time of line searches in seconds
+			real total_time = 0.0;					///<Time of whole simulation in seconds
+			uint nonzeros = 0;						///<Number of non-zeros of derivative, zero in matrix-free mode
+			uint factor_nonzeros = 0;				///<Number of non-zeros of last factors as if both triangles were stored, zero for iterative solvers
+			uint fill_in = 0;						///<Number of non-zeros created by factorization
+		};
+
+	private:
 		///File header
 		struct Header
 		{
@@ -46,6 +170,9 @@ namespace p6
 		struct Node : StaticNode
 		{
 			Coord coord_simulated;
+			bool warm = false;	///<Indicator if coord_simulated is converged and can be used as initial state
+			bool tracked = false;	///<Indicator if node's displacement is recorded after every load increment
+			std::vector<Coord> path;	///<Displacements recorded after every load increment
 		};
 
 		///Stick data
@@ -55,12 +182,52 @@ namespace p6
 			uint material;
 			real area;
 		};
-		
-		///Force data
-		struct Force
+
+		///Flat data created once per simulation: derivative's structure, order of sticks and compiled model of sticks and nodes
+		struct Assembly
 		{
-			uint node;
-			Coord direction;
+			std::vector<uint> slot;			///<Value slots of derivative every stick writes to, one stick after another
+			std::vector<uint> slot_offset;	///<Index of every stick's first slot
+			std::vector<uint> color;		///<Sticks sorted by colors, sticks of one color have no common non-fixed nodes
+			std::vector<uint> color_offset;	///<Index of every color's first stick in color
+			std::vector<uint> chunk_offset;	///<Index of every chunk's first stick in color, chunk holds sticks of one color and one freedom class
+			std::vector<unsigned char> chunk_class;	///<Freedom class of every chunk, first node's freedom * 3 + second node's freedom
+			std::vector<unsigned char> chunk_linear;	///<Indicator if chunk's sticks are made of linear materials
+			std::vector<uint> color_chunk_offset;	///<Index of every color's first chunk
+			std::vector<uint> node_stick;	///<Sticks of every node as stick * 2 + side, one node after another
+			std::vector<uint> node_stick_offset;	///<Index of every node's first stick in node_stick
+			std::vector<uint> index;		///<Index of first degree of freedom of every stick's side (stick * 2 + side)
+			std::vector<unsigned char> freedom;	///<Degree of freedom of every stick's side
+			std::vector<Coord> origin;		///<Initial coordinates of every stick's side
+			std::vector<Coord> rail;		///<Unit rail vector of every stick's side
+			std::vector<real> initial_length;	///<Initial length of every stick
+			std::vector<real> area;			///<Area of every stick
+			std::vector<const Material*> material;	///<Material of every stick
+			std::vector<real> modulus;		///<Young's modulus of every stick made of linear material
+			std::vector<uint> node_index;	///<Index of first degree of freedom of every node
+			std::vector<unsigned char> node_freedom;	///<Degree of freedom of every node
+			std::vector<Coord> node_rail;	///<Unit rail vector of every node
+		};
+
+		static const uint _max_chunk = 256;	///<Largest number of sticks in chunk
+
+		///Evaluated sticks of chunk, indexed by position in chunk
+		struct Evaluation
+		{
+			real dx[_max_chunk], dy[_max_chunk];			///<Vectors from first to second node
+			real ex[_max_chunk], ey[_max_chunk];			///<Unit vectors from first to second node
+			real length[_max_chunk];				///<Lengths
+			real tension[_max_chunk];				///<Tensions
+			real kxx[_max_chunk], kxy[_max_chunk], kyy[_max_chunk];	///<2x2 stiffnesses
+		};
+
+		///Factorization of derivative reused between Newton iterations and load increments
+		struct Factorization
+		{
+			bool valid = false;					///<Indicator if solver holds factorization of derivative
+			bool current = false;				///<Indicator if factorization belongs to current state
+			std::vector<DenseVector> step;		///<Steps of BFGS updates since factorization
+			std::vector<DenseVector> change;	///<Residual changes of BFGS updates since factorization
 		};
 
 		std::vector<Node> _node;			///<List of all nodes
@@ -68,23 +235,92 @@ namespace p6
 		std::vector<Force> _force;			///<List of all forces
 		std::vector<Material*> _material;	///<List of all materials
 		bool _simulation = false;			///<Indicator if simulation is being run
+		uint _thread_count = 1;				///<Number of threads used for simulation
+		Solver _solver = Solver::lu;		///<Solver of linear systems used for simulation
+		Preconditioner _preconditioner = Preconditioner::amg;	///<Preconditioner of iterative solvers
+		bool _matrix_free = false;			///<Indicator if derivative is applied stick by stick without forming matrix
+		bool _warm_start = true;			///<Indicator if simulation starts from last converged state
+		uint _load_steps = 1;				///<Initial number of load increments
+		bool _renumbering = false;			///<Indicator if degrees of freedom are numbered in reverse Cuthill-McKee order
+		bool _mixed_precision = false;		///<Indicator if direct solvers factorize derivative in single precision
+		SolverOptions _options;				///<Stopping criteria and limits of Newton's method
+		SimulationReport _report;			///<Report of last simulation
+		AsyncSimulation *_async = nullptr;	///<Asynchronous simulation running on construction, nullptr if none
+		friend class AsyncSimulation;
+		std::function<void(const SimulationIteration &)> _iteration_callback;	///<Function called after every Newton iteration of simulate
+		std::vector<real> _path_load;		///<Load factors of recorded load increments
+		std::vector<uint> _last_map;		///<Node-to-free map of last simulation
+		std::unique_ptr<SparseMatrix> _last_derivative;	///<Last factorized derivative of last simulation
+		std::unique_ptr<LinearSolver> _last_solver;		///<Solver with last factorization of last simulation, nullptr in matrix-free mode or with early exit
 
 		///Checks if materials of all sticks are specified
 		void _check_materials_specified() const;
 		///Creates node -> equation/variable map, returns degree of freedom
-		unsigned int _create_map(std::vector<uint> *map) noexcept;
+		unsigned int _create_map(std::vector<uint> *map) const noexcept;
+		///Orders non-fixed nodes with reverse Cuthill-McKee algorithm over sticks
+		void _create_ordering(std::vector<uint> *order) const noexcept;
 		///Finds smallest external force
-		real _find_smallest_force() const noexcept;
+		real _find_smallest_force(const std::vector<Force> *force) const noexcept;
 		///Copies coordinates from coord to simulated_coord
 		void _copy_state() noexcept;
-		///Creates state and fills with initial values
-		void _create_state(const std::vector<uint> *map, DenseVector *state) noexcept;
+		///Creates state from initial coordinates or from last converged ones (if warm), returns true if converged coordinates were used
+		bool _create_state(const std::vector<uint> *map, const Assembly *assembly, bool warm, DenseVector *state) const noexcept;
 		///Read state and write simulated coordinates
 		void _apply_state(const std::vector<uint> *map, const DenseVector *state) noexcept;
-		///Fills derivative and residual with values
-		void _fill_derivative_and_residual(const std::vector<uint> *map, const DenseVector *state, TripletVector *buffer, DenseVector *residual, SparseMatrix *derivative) noexcept;
+		///Records displacements of tracked nodes at given load factor
+		void _record_path(const std::vector<uint> *map, const DenseVector *state, real load_factor) noexcept;
+		///Gets node's degrees of freedom as vectors, returns their number
+		unsigned int _get_basis(uint node, Coord basis[2]) const noexcept;
+		///Gets node's coordinates in given state
+		Coord _get_coord(uint node, const std::vector<uint> *map, const DenseVector *state) const noexcept;
+		///Creates derivative's structure and finds value slots every stick writes to
+		void _create_pattern(const std::vector<uint> *map, SparseMatrix *derivative, Assembly *assembly) const noexcept;
+		///Colors sticks so that sticks of one color can be assembled in parallel, groups them into chunks of one freedom class
+		void _create_colors(Assembly *assembly) const noexcept;
+		///Finds sticks of every node
+		void _create_adjacency(Assembly *assembly) const noexcept;
+		///Creates flat per-stick and per-node data used by Newton's method
+		void _create_model(const std::vector<uint> *map, Assembly *assembly) const noexcept;
+		///Gets coordinates of stick's side (stick * 2 + side) in given state
+		Coord _get_side_coord(const Assembly *assembly, uint side, const DenseVector *state) const noexcept;
+		///Gets degrees of freedom of stick's side as vectors, returns their number
+		unsigned int _get_side_basis(const Assembly *assembly, uint side, Coord basis[2]) const noexcept;
+		///Creates residual created by external forces
+		void _create_load(const std::vector<uint> *map, const std::vector<Force> *force, DenseVector *load) const noexcept;
+		///Gets coordinates of stick's side with given degree of freedom in given state
+		template<unsigned char F> Coord _get_side_coord(const Assembly *assembly, uint side, const DenseVector *state) const noexcept;
+		///Gets degrees of freedom of stick's side with given degree of freedom as vectors, returns their number
+		template<unsigned char F> unsigned int _get_side_basis(const Assembly *assembly, uint side, Coord basis[2]) const noexcept;
+		///Evaluates tensions of chunk's sticks and their stiffnesses (if stiffness is true), F0 and F1 are freedoms of sticks' nodes
+		template<unsigned char F0, unsigned char F1> void _evaluate_chunk(uint chunk, const DenseVector *state, const Assembly *assembly, bool stiffness, Evaluation *evaluation) const noexcept;
+		///Adds forces of chunk's sticks to residual, their derivatives to derivative's values (if not nullptr) and writes their 2x2 stiffnesses (if not nullptr), F0 and F1 are freedoms of sticks' nodes
+		template<unsigned char F0, unsigned char F1> void _fill_chunk(uint chunk, const DenseVector *state, const Assembly *assembly, DenseVector *residual, real *values, std::vector<real> *stiffness) const noexcept;
+		///Calculates forces acting on first nodes of chunk's sticks, F0 and F1 are freedoms of sticks' nodes
+		template<unsigned char F0, unsigned char F1> void _get_chunk_force(uint chunk, const DenseVector *state, const Assembly *assembly, std::vector<Coord> *force) const noexcept;
+		///Calls function for every chunk, color by color, chunks of one color in parallel
+		void _for_each_chunk(const Assembly *assembly, ThreadPool *pool, const std::function<void(uint)> &function) const noexcept;
+		///Calls function for every stick, color by color, sticks of one color in parallel
+		void _for_each_stick(const Assembly *assembly, ThreadPool *pool, const std::function<void(uint)> &function) const noexcept;
+		///Fills residual, derivative (if not nullptr, structure must be created with _create_pattern) and sticks' stiffnesses (if not nullptr)
+		void _fill_derivative_and_residual(const DenseVector *state, const DenseVector *load, const Assembly *assembly, ThreadPool *pool, DenseVector *residual, SparseMatrix *derivative, std::vector<real> *stiffness) const noexcept;
+		///Fills residual node by node and returns it's maximal absolute value, sticks' forces are stored in force
+		real _get_residual(const DenseVector *state, const DenseVector *load, const Assembly *assembly, ThreadPool *pool, std::vector<Coord> *force, DenseVector *residual) const noexcept;
+		///Multiplies vector with derivative assembled from sticks' stiffnesses
+		void _apply_stiffness(const Assembly *assembly, ThreadPool *pool, const std::vector<real> *stiffness, const DenseVector *vector, DenseVector *result) const noexcept;
+		///Computes derivative's diagonal from sticks' stiffnesses
+		void _get_stiffness_diagonal(const Assembly *assembly, ThreadPool *pool, const std::vector<real> *stiffness, DenseVector *diagonal) const noexcept;
+		///Creates solver of linear systems
+		LinearSolver *_create_solver(const std::vector<uint> *map, unsigned int freedom) const;
+		///Returns absolute residual tolerance of simulation with given smallest force and load
+		real _get_tolerance(real smallest_force, const DenseVector *load) const noexcept;
 		///Limit corrections with fraction of stick's length
-		void _fix_infinite_correction(const std::vector<uint> *map, const DenseVector *state, DenseVector *correction) noexcept;
+		void _fix_infinite_correction(const DenseVector *state, const Assembly *assembly, DenseVector *correction) const noexcept;
+		///Solves with factorization updated by BFGS pairs of steps and residual changes
+		void _solve_bfgs(LinearSolver *solver, const std::vector<DenseVector> *step, const std::vector<DenseVector> *change, const DenseVector *residual, DenseVector *correction) const;
+		///Runs Newton's method until residual is below tolerance, returns false if it does not converge. Solver is nullptr in matrix-free mode, pool and report may be nullptr
+		bool _newton(const DenseVector *load, const Assembly *assembly, ThreadPool *pool, LinearSolver *solver, SparseMatrix *derivative, Factorization *factorization, real tolerance, DenseVector *state, uint *iterations, SimulationReport *report) const;
+		///Applies load in increments starting from unloaded state (or from given state if warm), calls record (if not empty) with every converged state, returns false if it does not converge. Report may be nullptr
+		bool _continuation(const std::vector<uint> *map, const DenseVector *load, const Assembly *assembly, ThreadPool *pool, LinearSolver *solver, SparseMatrix *derivative, Factorization *factorization, real tolerance, bool warm, DenseVector *state, const std::function<void(const DenseVector &, real)> &record, SimulationReport *report) const;
 
 	public:
 		//Node
@@ -97,10 +333,15 @@ namespace p6
 		Coord get_node_coord(uint node)							const noexcept;	///<Returns node's coordinates
 		unsigned char get_node_freedom(uint node)				const noexcept;	///<Returns if node's degree of freedom
 		Coord get_node_rail_vector(uint node)					const noexcept;	///<Returns node's rail vector (for nodes fixed on rail)
+		void set_node_tracked(uint node, bool tracked)			noexcept;		///<Sets if node's load-displacement path is recorded
+		bool get_node_tracked(uint node)						const noexcept;	///<Returns if node's load-displacement path is recorded
+		Coord get_node_path(uint node, uint point)				const noexcept;	///<Returns tracked node's displacement at point of load-displacement path
 		
 		//Stick
 		uint create_stick(const uint node[2])					noexcept;		///<Creates stick or finds existing one, returns it's index
 		void delete_stick(uint stick)							noexcept;		///<Deletes stick
+		void create_sticks(const std::vector<uint> *node, uint material, real area)	noexcept;	///<Creates sticks between pairs of nodes stored one after another, does not look for existing ones
+		void delete_sticks(const std::vector<uint> *stick)		noexcept;		///<Deletes sticks given in ascending order
 		void set_stick_material(uint stick, uint material)		noexcept;		///<Sets stick's material
 		void set_stick_area(uint stick, real area)				noexcept;		///<Sets stick's cross-sectional area
 		uint get_stick_count()									const noexcept;	///<Returns stick number
@@ -133,8 +374,37 @@ namespace p6
 		void save(const String filepath) const;	///<Saves construction to file
 		void load(const String filepath);		///<Loads constuction from file
 		void import(const String filepath);		///<Imports consruction from file
-		void simulate(bool sim);				///<Runs or inverts simulation
+		void simulate(bool sim);				///<Runs or inverts simulation, throws ConvergenceError if simulation does not converge
+		std::unique_ptr<AsyncSimulation> simulate_async(real timeout = 0.0);	///<Runs simulation in background thread, stops it after timeout in seconds (zero means none), construction must not be accessed until it finishes
+		bool get_simulation() const noexcept;	///<Returns if simulation is being run
+		void get_sensitivity(Response response, uint index, Coord direction, std::vector<real> *area, std::vector<Coord> *coord);	///<Computes derivatives of response by sticks' areas and nodes' coordinates, index is node or stick (ignored for compliance), direction is used for node displacement, refactorizes derivative if last factorization does not belong to converged state (after early exit)
+		void simulate_load_cases(const std::vector<std::vector<Force>> &cases, LoadCaseResult *result) const;	///<Simulates construction with every set of forces instead of own forces, cases that do not converge are flagged, other errors are rethrown
+		void set_thread_count(uint count) noexcept;	///<Sets number of threads used for simulation, 0 means hardware concurrency
+		uint get_thread_count() const noexcept;	///<Returns number of threads used for simulation
+		void set_solver(Solver solver) noexcept;	///<Sets solver of linear systems used for simulation
+		Solver get_solver() const noexcept;		///<Returns solver of linear systems used for simulation
+		void set_preconditioner(Preconditioner preconditioner) noexcept;	///<Sets preconditioner of iterative solvers
+		Preconditioner get_preconditioner() const noexcept;	///<Returns preconditioner of iterative solvers
+		void set_matrix_free(bool matrix_free) noexcept;	///<Sets if derivative is applied stick by stick (always with Krylov solver and Jacobi preconditioner)
+		bool get_matrix_free() const noexcept;	///<Returns if derivative is applied stick by stick
+		void set_warm_start(bool warm_start) noexcept;	///<Sets if simulation starts from last converged state (projected to new nodes)
+		bool get_warm_start() const noexcept;	///<Returns if simulation starts from last converged state
+		void set_load_steps(uint steps) noexcept;	///<Sets initial number of load increments, increments are halved or doubled depending on convergence
+		uint get_load_steps() const noexcept;	///<Returns initial number of load increments
+		void set_renumbering(bool renumbering) noexcept;	///<Sets if degrees of freedom are renumbered to reduce bandwidth of derivative, helps poorly ordered imported constructions
+		bool get_renumbering() const noexcept;	///<Returns if degrees of freedom are renumbered
+		void set_mixed_precision(bool mixed_precision) noexcept;	///<Sets if direct solvers factorize derivative in single precision and refine solutions in double precision, halves memory of factors
+		bool get_mixed_precision() const noexcept;	///<Returns if direct solvers factorize derivative in single precision
+		void set_solver_options(const SolverOptions &options) noexcept;	///<Sets stopping criteria and limits of Newton's method
+		const SolverOptions &get_solver_options() const noexcept;	///<Returns stopping criteria and limits of Newton's method
+		void set_iteration_callback(const std::function<void(const SimulationIteration &)> &callback) noexcept;	///<Sets function called after every Newton iteration of simulate, empty function means none, not copied with construction
+		const SimulationReport &get_report() const noexcept;	///<Returns report of last simulation
+		uint get_path_size() const noexcept;	///<Returns number of points of load-displacement path recorded during last simulation
+		real get_path_load(uint point) const noexcept;	///<Returns load factor at point of load-displacement path
 
+		Construction() noexcept;				///<Creates empty construction
+		Construction(const Construction &construction);	///<Copies construction, including materials
+		Construction &operator=(const Construction &construction);	///<Copies construction, including materials
 		~Construction();						///<Destroys construction
 	};
 }
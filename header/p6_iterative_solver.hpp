@@ -0,0 +1,89 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#ifndef P6_ITERATIVE_SOLVER
+#define P6_ITERATIVE_SOLVER
+
+#include "p6_linear_solver.hpp"
+#include "p6_preconditioner.hpp"
+#include <functional>
+#include <memory>
+
+namespace p6
+{
+	///Symmetric linear operator, not necessary stored as matrix
+	class LinearOperator
+	{
+	public:
+		virtual void apply(const DenseVector &vector, DenseVector *result) const = 0;	///<Multiplies vector with operator
+		virtual ~LinearOperator() noexcept;												///<Destroys operator
+	};
+
+	///Linear operator stored as sparse matrix
+	class MatrixOperator : public LinearOperator
+	{
+	private:
+		const SparseMatrix *_matrix;													///<Matrix, not owned
+
+	public:
+		MatrixOperator(const SparseMatrix *matrix) noexcept;							///<Creates operator from matrix
+		virtual void apply(const DenseVector &vector, DenseVector *result) const;
+	};
+
+	///Linear operator given as function
+	class FunctionOperator : public LinearOperator
+	{
+	private:
+		std::function<void(const DenseVector &, DenseVector *)> _function;				///<Function multiplying vector with operator
+
+	public:
+		FunctionOperator(const std::function<void(const DenseVector &, DenseVector *)> &function);	///<Creates operator from function
+		virtual void apply(const DenseVector &vector, DenseVector *result) const;
+	};
+
+	///Preconditioned Krylov solver of symmetric systems
+	class IterativeSolver : public LinearSolver
+	{
+	public:
+		///Krylov method
+		enum class Method
+		{
+			cg,		///<Conjugate gradients, requires positive definite matrix
+			minres	///<Minimal residual, works with indefinite matrices
+		};
+
+	private:
+		Method _method;									///<Krylov method
+		std::unique_ptr<Preconditioner> _preconditioner;///<Preconditioner
+		const SparseMatrix *_matrix = nullptr;			///<Last factorized matrix, not owned
+		real _tolerance = 1e-10;						///<Relative tolerance of next solution
+
+	public:
+		static const uint max_iterations = 1000;		///<Maximal number of iterations
+
+		IterativeSolver(Method method, Preconditioner *preconditioner) noexcept;	///<Creates solver, takes ownership of preconditioner
+		virtual void analyze(const SparseMatrix &matrix);
+		virtual bool factorize(const SparseMatrix &matrix);							///<Computes preconditioner, matrix must live until next factorization
+		virtual void solve(const DenseVector &right, DenseVector *solution);
+		virtual void set_tolerance(real tolerance) noexcept;
+
+		///Solves system with given operator starting with zero, returns number of iterations
+		static uint solve(Method method, const LinearOperator &matrix, const Preconditioner &preconditioner,
+			const DenseVector &right, DenseVector *solution, real tolerance, uint max_iterations);
+		///Solves system with conjugate gradients starting with zero, returns number of iterations
+		static uint conjugate_gradient(const LinearOperator &matrix, const Preconditioner &preconditioner,
+			const DenseVector &right, DenseVector *solution, real tolerance, uint max_iterations);
+		///Solves system with minimal residual method starting with zero, returns number of iterations
+		static uint minimal_residual(const LinearOperator &matrix, const Preconditioner &preconditioner,
+			const DenseVector &right, DenseVector *solution, real tolerance, uint max_iterations);
+	};
+}
+
+#endif
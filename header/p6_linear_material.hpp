@@ -28,6 +28,7 @@ namespace p6
 		virtual Type type() 							const noexcept;	///<Returns type of material
 		virtual real stress(real strain)				const noexcept;	///<Returns stress in dependence of strain
 		virtual real derivative(real strain)			const noexcept;	///<Returns derivative of stress by strain
+		virtual void evaluate(real strain, real *stress, real *derivative) const noexcept;	///<Returns stress and derivative, can be called from several threads
 	};
 }
 
@@ -0,0 +1,101 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#ifndef P6_LINEAR_SOLVER
+#define P6_LINEAR_SOLVER
+
+#include "p6_matrix.hpp"
+#include <Eigen/SparseCholesky>
+#include <Eigen/SparseLU>
+
+namespace p6
+{
+	///Solver of sparse linear systems, separated into symbolic analysis, numeric factorization and solution
+	class LinearSolver
+	{
+	public:
+		virtual void analyze(const SparseMatrix &matrix) = 0;						///<Analyzes sparsity pattern of matrix
+		virtual bool factorize(const SparseMatrix &matrix) = 0;						///<Factorizes matrix with analyzed pattern, returns false on failure
+		virtual void solve(const DenseVector &right, DenseVector *solution) = 0;	///<Solves system with factorized matrix
+		virtual void set_tolerance(real tolerance) noexcept;						///<Sets relative tolerance of following solutions, ignored by direct solvers
+		virtual uint get_factor_nonzeros() const noexcept;							///<Returns number of non-zeros of factors as if both triangles were stored, zero for iterative solvers
+		virtual ~LinearSolver() noexcept;											///<Destroys solver
+	};
+
+	///LU solver with COLAMD ordering, works with every nonsingular matrix
+	class LUSolver : public LinearSolver
+	{
+	private:
+		Eigen::SparseLU<SparseMatrix, Eigen::COLAMDOrdering<int>> _solver;	///<Eigen solver
+
+	public:
+		virtual void analyze(const SparseMatrix &matrix);
+		virtual bool factorize(const SparseMatrix &matrix);
+		virtual void solve(const DenseVector &right, DenseVector *solution);
+		virtual uint get_factor_nonzeros() const noexcept;
+	};
+
+	///Cholesky-like solver of symmetric matrices, falls back to LU if matrix is not positive definite
+	template<class Solver> class CholeskySolver : public LinearSolver
+	{
+	private:
+		Solver _solver;					///<Eigen solver
+		LUSolver _fallback;				///<Solver used if matrix is not positive definite
+		bool _fallback_analyzed = false;///<Indicator if fallback solver analyzed current pattern
+		bool _fallback_used = false;	///<Indicator if fallback solver factorized current matrix
+		bool _positive_definite() const noexcept;	///<Checks if factorized matrix was positive definite
+
+	public:
+		virtual void analyze(const SparseMatrix &matrix);
+		virtual bool factorize(const SparseMatrix &matrix);
+		virtual void solve(const DenseVector &right, DenseVector *solution);
+		virtual uint get_factor_nonzeros() const noexcept;
+	};
+
+	///LDLT solver with AMD ordering
+	typedef CholeskySolver<Eigen::SimplicialLDLT<SparseMatrix, Eigen::Lower, Eigen::AMDOrdering<int>>> LDLTSolver;
+	///LLT solver with AMD ordering
+	typedef CholeskySolver<Eigen::SimplicialLLT<SparseMatrix, Eigen::Lower, Eigen::AMDOrdering<int>>> LLTSolver;
+
+	///Solver factorizing matrix in single precision and refining solutions against double precision matrix, falls back to double precision solver if refinement stalls
+	template<class Solver, class Fallback> class MixedPrecisionSolver : public LinearSolver
+	{
+	private:
+		typedef Eigen::SparseMatrix<float> FloatMatrix;	///<Single precision sparse matrix
+		typedef Eigen::VectorXf FloatVector;			///<Single precision dense vector
+		Solver _solver;						///<Eigen solver in single precision
+		FloatMatrix _matrix;				///<Single precision copy of factorized matrix
+		const SparseMatrix *_double_matrix = nullptr;	///<Factorized matrix, used to calculate residuals, not owned
+		Fallback _fallback;					///<Double precision solver used if single precision fails
+		bool _fallback_analyzed = false;	///<Indicator if fallback solver analyzed current pattern
+		bool _fallback_used = false;		///<Indicator if fallback solver factorized current matrix
+		bool _stalled = false;				///<Indicator if refinement stalled with current pattern, following matrices are factorized in double precision
+		real _tolerance = 1e-12;			///<Relative residual of refined solutions, close to double precision independently of set_tolerance
+		bool _factorized() const noexcept;	///<Checks if single precision factorization succeeded
+		bool _factorize_fallback();			///<Factorizes matrix with fallback solver
+
+	public:
+		static const uint max_refinements = 20;	///<Largest number of refinement steps
+		virtual void analyze(const SparseMatrix &matrix);
+		virtual bool factorize(const SparseMatrix &matrix);	///<Factorizes matrix, matrix must live until solutions are done
+		virtual void solve(const DenseVector &right, DenseVector *solution);	///<Solves system, throws if refinement stalls and matrix can not be factorized in double precision
+		virtual uint get_factor_nonzeros() const noexcept;
+		bool get_fallback_used() const noexcept;			///<Returns if current matrix is factorized in double precision
+	};
+
+	///LU solver with COLAMD ordering in single precision
+	typedef MixedPrecisionSolver<Eigen::SparseLU<Eigen::SparseMatrix<float>, Eigen::COLAMDOrdering<int>>, LUSolver> MixedLUSolver;
+	///LDLT solver with AMD ordering in single precision
+	typedef MixedPrecisionSolver<Eigen::SimplicialLDLT<Eigen::SparseMatrix<float>, Eigen::Lower, Eigen::AMDOrdering<int>>, LDLTSolver> MixedLDLTSolver;
+	///LLT solver with AMD ordering in single precision
+	typedef MixedPrecisionSolver<Eigen::SimplicialLLT<Eigen::SparseMatrix<float>, Eigen::Lower, Eigen::AMDOrdering<int>>, LLTSolver> MixedLLTSolver;
+}
+
+#endif
@@ -33,6 +33,7 @@ namespace p6
 		virtual Type type()					const noexcept = 0;	///<Returns type of material
 		virtual real stress(real strain)	const noexcept = 0;	///<Returns stress in dependence of strain
 		virtual real derivative(real strain)const noexcept = 0;	///<Returns derivative of stress by strain
+		virtual void evaluate(real strain, real *stress, real *derivative) const noexcept = 0;	///<Returns stress and derivative, can be called from several threads
 		virtual ~Material()					noexcept = 0;		///<Destroys material
 	};
 }
@@ -0,0 +1,50 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#ifndef P6_MATRIX
+#define P6_MATRIX
+
+#include "p6_common.hpp"
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <vector>
+
+namespace p6
+{
+	///Dense vector
+	class DenseVector : public Eigen::Matrix<p6::real, Eigen::Dynamic, 1>
+	{
+	public:
+		using Eigen::Matrix<p6::real, Eigen::Dynamic, 1>::Matrix;
+	};
+
+	///Dense matrix
+	class DenseMatrix : public Eigen::Matrix<p6::real, Eigen::Dynamic, Eigen::Dynamic>
+	{
+	public:
+		using Eigen::Matrix<p6::real, Eigen::Dynamic, Eigen::Dynamic>::Matrix;
+	};
+
+	///Sparse matrix
+	class SparseMatrix : public Eigen::SparseMatrix<p6::real>
+	{
+	public:
+		using Eigen::SparseMatrix<p6::real>::SparseMatrix;
+	};
+
+	///Vector of triplets
+	class TripletVector : public std::vector<Eigen::Triplet<p6::real>>
+	{
+	public:
+		using std::vector<Eigen::Triplet<p6::real>>::vector;
+	};
+}
+
+#endif
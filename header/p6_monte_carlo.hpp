@@ -0,0 +1,81 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#ifndef P6_MONTE_CARLO
+#define P6_MONTE_CARLO
+
+#include "p6_construction.hpp"
+#include <vector>
+
+namespace p6
+{
+	///Monte Carlo simulation of construction with random areas, moduli and forces, statistics are collected without storing samples
+	class MonteCarlo
+	{
+	private:
+		///Quantile estimated with P-square algorithm, five markers are stored instead of samples
+		struct Quantile
+		{
+			real height[5];		///<Heights of markers
+			real position[5];	///<Actual positions of markers
+			real desired[5];	///<Desired positions of markers
+		};
+
+		const Construction *_construction;		///<Base construction, not owned
+		uint _seed = 0;							///<Seed of random numbers
+		uint _sample_count = 1000;				///<Number of samples
+		std::vector<real> _area_deviation;		///<Coefficients of variation of sticks' areas
+		std::vector<real> _modulus_deviation;	///<Coefficients of variation of materials' moduli
+		std::vector<real> _force_deviation;		///<Coefficients of variation of forces' magnitudes
+		std::vector<real> _force_limit;			///<Largest allowed absolute forces of sticks
+		std::vector<real> _displacement_limit;	///<Largest allowed displacements of nodes
+		std::vector<real> _probability;			///<Probabilities of estimated quantiles
+
+		uint _count = 0;						///<Number of converged samples
+		uint _failure_count = 0;				///<Number of failed samples
+		std::vector<uint> _stick_failure_count;	///<Number of samples exceeding stick's limit
+		std::vector<uint> _node_failure_count;	///<Number of samples exceeding node's limit
+		std::vector<real> _mean;				///<Means of displacements along x of all nodes, along y, forces of sticks
+		std::vector<real> _square_sum;			///<Sums of squared deviations from mean
+		std::vector<Quantile> _quantile;		///<Quantiles of values, all quantiles of one value after another
+
+		static real _uniform(uint seed, uint sample, uint variable) noexcept;			///<Returns random number in (0, 1) determined by seed, sample and variable only
+		static real _lognormal(uint seed, uint sample, uint variable, real deviation) noexcept;	///<Returns log-normal random number with mean 1 and given coefficient of variation
+		static void _add_quantile(Quantile *quantile, real probability, uint count, real value) noexcept;	///<Adds (count + 1)-th value to quantile's estimation
+		static real _get_quantile(const Quantile *quantile, real probability, uint count) noexcept;			///<Returns quantile estimated from count values
+		bool _simulate_sample(const Construction *mean, uint sample, real *values) const;	///<Simulates sample, writes it's values, returns false if simulation does not converge
+		void _add_sample(bool converged, const real *values) noexcept;			///<Adds sample's values to statistics
+
+	public:
+		MonteCarlo(const Construction *construction) noexcept;					///<Creates simulation of construction, construction must live and stay unchanged until simulation is done
+		void set_seed(uint seed) noexcept;										///<Sets seed of random numbers
+		void set_sample_count(uint count) noexcept;								///<Sets number of samples
+		void set_stick_area_deviation(uint stick, real deviation) noexcept;		///<Sets coefficient of variation of stick's area, areas are log-normal
+		void set_material_modulus_deviation(uint material, real deviation) noexcept;	///<Sets coefficient of variation of material's modulus (stress scale for non-linear materials), moduli are log-normal
+		void set_force_deviation(uint force, real deviation) noexcept;			///<Sets coefficient of variation of force's magnitude, magnitudes are log-normal
+		void set_stick_force_limit(uint stick, real limit) noexcept;			///<Sets largest allowed absolute force of stick
+		void set_node_displacement_limit(uint node, real limit) noexcept;		///<Sets largest allowed displacement of node
+		uint add_quantile(real probability) noexcept;							///<Adds quantile to estimate, returns it's index
+		void simulate();														///<Simulates all samples with construction's number of threads, errors other than non-convergence are rethrown
+
+		uint get_converged_count() const noexcept;								///<Returns number of converged samples
+		real get_failure_probability() const noexcept;							///<Returns fraction of samples that did not converge or exceeded any limit
+		real get_stick_failure_probability(uint stick) const noexcept;			///<Returns fraction of samples exceeding stick's force limit
+		real get_node_failure_probability(uint node) const noexcept;			///<Returns fraction of samples exceeding node's displacement limit
+		Coord get_node_displacement_mean(uint node) const noexcept;				///<Returns mean of node's displacement among converged samples
+		Coord get_node_displacement_variance(uint node) const noexcept;			///<Returns variance of node's displacement components among converged samples
+		Coord get_node_displacement_quantile(uint node, uint quantile) const noexcept;	///<Returns quantile of node's displacement components among converged samples
+		real get_stick_force_mean(uint stick) const noexcept;					///<Returns mean of stick's force among converged samples
+		real get_stick_force_variance(uint stick) const noexcept;				///<Returns variance of stick's force among converged samples
+		real get_stick_force_quantile(uint stick, uint quantile) const noexcept;	///<Returns quantile of stick's force among converged samples
+	};
+}
+
+#endif
@@ -75,7 +75,7 @@ namespace p6
 		String _formula;											///<Formula of stress in dependence of strain
 		std::vector<Operation> _operations;							///<Translated byte-code of the formula
 
-		void _calculate() const noexcept;							///<Calculates stress and derivative from strain
+		void _calculate(real strain, real *stress, real *derivative) const noexcept;	///<Calculates stress and derivative from strain
 
 	public:
 		NonlinearMaterial(const String name, const String formula);	///<Creates material from stress from strain formula
@@ -83,6 +83,7 @@ namespace p6
 		virtual Type type()							const noexcept;	///<Returns type of material
 		virtual real stress(real strain)			const noexcept;	///<Returns stress in dependence of strain
 		virtual real derivative(real strain)		const noexcept;	///<Returns derivative of stress by strain
+		virtual void evaluate(real strain, real *stress, real *derivative) const noexcept;	///<Returns stress and derivative, can be called from several threads
 	};
 }
 
@@ -0,0 +1,59 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#ifndef P6_OPTIMIZER
+#define P6_OPTIMIZER
+
+#include "p6_construction.hpp"
+#include <vector>
+
+namespace p6
+{
+	///Ground structure optimization: candidate sticks between nodes are sized to minimize compliance under volume and stress constraints, unneeded sticks are removed
+	class Optimizer
+	{
+	private:
+		Construction *_construction;			///<Optimized construction, not owned
+		real _max_length = 1.5;					///<Largest length of candidate sticks
+		uint _material = 0;						///<Material of candidate sticks
+		real _initial_area = 1.0;				///<Area of candidate sticks
+		real _volume_limit = 0.0;				///<Largest allowed volume, zero means volume of construction before optimization
+		real _stress_limit = 0.0;				///<Largest allowed absolute stress, zero means no limit
+		real _min_area = 1e-6;					///<Smallest area of sticks during optimization
+		real _removal_ratio = 1e-3;				///<Sticks thinner than this fraction of the thickest stick are removed
+		uint _max_iterations = 100;				///<Largest number of iterations
+		real _tolerance = 1e-3;					///<Largest change of area relative to the thickest stick considered as convergence
+		uint _iterations = 0;					///<Number of iterations of last optimization
+		real _compliance = 0.0;					///<Compliance before last update of areas
+		std::vector<real> _length;				///<Initial lengths of sticks
+
+		real _update_areas(const std::vector<real> *sensitivity, const std::vector<real> *force, real volume_limit, std::vector<real> *area) const noexcept;	///<Updates areas with optimality criteria, returns largest change
+		void _remove_sticks(std::vector<real> *area) noexcept;	///<Removes sticks thinner than removal ratio of the thickest stick and restrains nodes left unstable
+
+	public:
+		Optimizer(Construction *construction) noexcept;		///<Creates optimizer of construction, construction must live until optimization is done
+		void set_max_length(real length) noexcept;			///<Sets largest length of candidate sticks
+		void set_material(uint material) noexcept;			///<Sets material of candidate sticks
+		void set_initial_area(real area) noexcept;			///<Sets area of candidate sticks
+		void set_volume_limit(real volume) noexcept;		///<Sets largest allowed sum of areas multiplied with lengths, zero means volume before optimization
+		void set_stress_limit(real stress) noexcept;		///<Sets largest allowed absolute stress of sticks, zero means no limit, vanishing sticks are not limited
+		void set_min_area(real area) noexcept;				///<Sets smallest area of sticks during optimization, keeps derivative nonsingular
+		void set_removal_ratio(real ratio) noexcept;		///<Sets fraction of the thickest stick's area below which sticks are removed
+		void set_max_iterations(uint iterations) noexcept;	///<Sets largest number of iterations
+		void set_tolerance(real tolerance) noexcept;		///<Sets largest relative change of areas considered as convergence
+		uint generate();									///<Creates sticks between all pairs of nodes not farther than largest length, returns number of created sticks
+		bool optimize();									///<Optimizes areas, removes thin sticks and restrains unstable unloaded nodes, returns if optimization converged, can be called again to continue
+		uint get_iteration_count() const noexcept;			///<Returns number of iterations of last optimization
+		real get_compliance() const noexcept;				///<Returns compliance of last simulated iteration
+		real get_volume() const noexcept;					///<Returns sum of areas multiplied with lengths after last optimization
+	};
+}
+
+#endif
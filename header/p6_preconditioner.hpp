@@ -0,0 +1,90 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#ifndef P6_PRECONDITIONER
+#define P6_PRECONDITIONER
+
+#include "p6_matrix.hpp"
+#include <Eigen/IterativeLinearSolvers>
+#include <Eigen/QR>
+#include <Eigen/SparseCholesky>
+#include <memory>
+
+namespace p6
+{
+	///Symmetric positive definite approximation of inverse matrix used by iterative solvers
+	class Preconditioner
+	{
+	public:
+		virtual void analyze(const SparseMatrix &matrix);									///<Analyzes sparsity pattern of matrix
+		virtual void factorize(const SparseMatrix &matrix) = 0;								///<Computes preconditioner for matrix with analyzed pattern
+		virtual void apply(const DenseVector &right, DenseVector *solution) const = 0;		///<Applies approximate inverse
+		virtual ~Preconditioner() noexcept;													///<Destroys preconditioner
+	};
+
+	///Inverse of matrix's diagonal
+	class JacobiPreconditioner : public Preconditioner
+	{
+	private:
+		DenseVector _inverse_diagonal;														///<Inverse diagonal
+
+	public:
+		virtual void factorize(const SparseMatrix &matrix);
+		void factorize(const DenseVector &diagonal);										///<Computes preconditioner from diagonal
+		virtual void apply(const DenseVector &right, DenseVector *solution) const;
+	};
+
+	///Incomplete Cholesky factorization with AMD ordering and diagonal shift
+	class CholeskyPreconditioner : public Preconditioner
+	{
+	private:
+		mutable Eigen::IncompleteCholesky<real, Eigen::Lower, Eigen::AMDOrdering<int>> _cholesky;	///<Eigen factorization
+
+	public:
+		virtual void analyze(const SparseMatrix &matrix);
+		virtual void factorize(const SparseMatrix &matrix);
+		virtual void apply(const DenseVector &right, DenseVector *solution) const;
+	};
+
+	///Smoothed aggregation algebraic multigrid, one V-cycle with damped Jacobi smoothing
+	class AMGPreconditioner : public Preconditioner
+	{
+	private:
+		///One level of hierarchy
+		struct Level
+		{
+			SparseMatrix matrix;				///<Matrix of the level
+			DenseVector inverse_diagonal;		///<Inverse diagonal of matrix
+			real weight;						///<Jacobi weight, 4 / 3 of inverse spectral radius estimate of D^-1 * A
+			SparseMatrix prolongation;			///<Prolongation from the next coarser level
+			SparseMatrix restriction;			///<Transposed prolongation
+			mutable DenseVector right;			///<Right side buffer
+			mutable DenseVector solution;		///<Solution buffer
+			mutable DenseVector residual;		///<Residual buffer
+		};
+
+		std::vector<Level> _level;				///<Levels from the finest to the coarsest
+		DenseMatrix _null_space;				///<Near null space of the finest matrix, one mode per column
+		std::vector<uint> _block;				///<Block (node) of every unknown of the finest matrix
+		Eigen::SimplicialLDLT<SparseMatrix, Eigen::Lower, Eigen::AMDOrdering<int>> _coarse;	///<Direct solver on the coarsest level
+
+		void _aggregate(const SparseMatrix &matrix, const std::vector<uint> &block, uint block_count,
+			std::vector<uint> *aggregate, uint *count) const;	///<Groups strongly connected blocks
+		void _smooth(const Level &level, uint count) const noexcept;									///<Applies damped Jacobi sweeps
+		void _cycle(uint level) const noexcept;															///<Performs V-cycle starting at level
+
+	public:
+		void set_null_space(const DenseMatrix &null_space, const std::vector<uint> &block);	///<Sets near null space (rigid body modes) and blocks of unknowns aggregated together
+		virtual void factorize(const SparseMatrix &matrix);
+		virtual void apply(const DenseVector &right, DenseVector *solution) const;
+	};
+}
+
+#endif
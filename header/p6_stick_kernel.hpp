@@ -0,0 +1,67 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#ifndef P6_STICK_KERNEL
+#define P6_STICK_KERNEL
+
+#include "p6_common.hpp"
+
+namespace p6
+{
+	///Vectorized evaluation of sticks made of linear materials, instruction set is chosen at runtime
+	class StickKernel
+	{
+	public:
+		///Instruction set used for evaluation
+		enum class Level
+		{
+			scalar,
+			avx2,
+			avx512
+		};
+
+		///Sticks evaluated at once, inputs are indexed by stick, outputs by position in batch
+		struct Batch
+		{
+			uint count;					///<Number of sticks
+			const uint *stick;			///<Indices of sticks
+			const real *dx;				///<Differences of sticks' ends' coordinates along x
+			const real *dy;				///<Differences of sticks' ends' coordinates along y
+			const real *initial_length;	///<Initial lengths of all sticks
+			const real *area;			///<Areas of all sticks
+			const real *modulus;		///<Young's moduli of all sticks
+			real *ex;					///<Unit vectors along sticks, x components
+			real *ey;					///<Unit vectors along sticks, y components
+			real *length;				///<Lengths of sticks
+			real *tension;				///<Tensions of sticks
+			real *kxx;					///<Stiffnesses of sticks, xx components, nullptr if not needed
+			real *kxy;					///<Stiffnesses of sticks, xy components, nullptr if not needed
+			real *kyy;					///<Stiffnesses of sticks, yy components, nullptr if not needed
+		};
+
+	private:
+		typedef void Function(const Batch *batch);	///<Function evaluating batch
+		static Function *_function;		///<Function of current level
+
+		static void _evaluate_scalar(const Batch *batch, uint begin) noexcept;	///<Evaluates sticks starting from begin without vector instructions
+		static void _evaluate_avx2(const Batch *batch) noexcept;		///<Evaluates sticks with AVX2 instructions
+		static void _evaluate_avx512(const Batch *batch) noexcept;		///<Evaluates sticks with AVX-512 instructions
+		static void _evaluate_none(const Batch *batch) noexcept;		///<Evaluates sticks without vector instructions
+		static Function *_get_function(Level level) noexcept;		///<Returns function of level
+
+	public:
+		static Level get_supported_level() noexcept;	///<Returns best instruction set supported by processor and compiler
+		static Level get_level() noexcept;				///<Returns instruction set in use, best supported one by default
+		static void set_level(Level level) noexcept;	///<Sets instruction set in use, limited to supported ones, must not be called during simulation
+		static void evaluate(const Batch *batch) noexcept;	///<Evaluates sticks, results are identical for all instruction sets
+	};
+}
+
+#endif
@@ -0,0 +1,66 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#ifndef P6_SWEEP
+#define P6_SWEEP
+
+#include "p6_construction.hpp"
+#include <vector>
+
+namespace p6
+{
+	///Simulation of many variants of one construction, results are stored column by column
+	class Sweep
+	{
+	private:
+		///Parameter changed in variant
+		enum class Parameter
+		{
+			stick_area,
+			material_modulus,
+			material_formula,
+			node_coord,
+			force_magnitude
+		};
+
+		///Changed parameter
+		struct Override
+		{
+			Parameter parameter;
+			uint index;
+			real value;
+			Coord coord;
+			String formula;
+		};
+
+		const Construction *_construction;				///<Base construction, not owned
+		std::vector<std::vector<Override>> _override;	///<Changed parameters of every variant
+		std::vector<unsigned char> _converged;			///<Indicator if variant converged
+		std::vector<real> _result;						///<Displacements along x of all nodes, along y, forces of sticks, every column holds values of all variants
+
+		void _simulate_variant(uint variant);			///<Simulates variant and writes it's results, results stay NaN if variant does not converge
+
+	public:
+		Sweep(const Construction *construction) noexcept;									///<Creates sweep over construction, construction must live and stay unchanged until sweep is simulated
+		uint create_variant() noexcept;														///<Creates variant equal to construction, returns it's index
+		uint get_variant_count() const noexcept;											///<Returns variant number
+		void set_stick_area(uint variant, uint stick, real area) noexcept;					///<Sets stick's cross-sectional area in variant
+		void set_material_modulus(uint variant, uint material, real modulus) noexcept;		///<Makes material linear with given Young's modulus in variant
+		void set_material_formula(uint variant, uint material, const String formula) noexcept;	///<Makes material non-linear with given formula in variant
+		void set_node_coord(uint variant, uint node, Coord coord) noexcept;					///<Sets node's coordinates in variant
+		void set_force_magnitude(uint variant, uint force, real magnitude) noexcept;		///<Sets force's magnitude keeping it's direction in variant
+		void simulate();																	///<Simulates all variants with construction's number of threads, errors other than non-convergence are rethrown
+		bool get_converged(uint variant) const noexcept;									///<Returns if variant converged, results of other variants are NaN
+		const real *get_node_displacement(uint node, unsigned int axis) const noexcept;		///<Returns node's displacements along x (axis 0) or y (axis 1) in all variants
+		const real *get_stick_force(uint stick) const noexcept;								///<Returns stick's forces in all variants
+	};
+}
+
+#endif
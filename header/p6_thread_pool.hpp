@@ -0,0 +1,50 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#ifndef P6_THREAD_POOL
+#define P6_THREAD_POOL
+
+#include "p6_common.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace p6
+{
+	///Fixed set of worker threads executing indexed tasks
+	class ThreadPool
+	{
+	private:
+		std::vector<std::thread> _thread;				///<Worker threads, calling thread is not included
+		std::mutex _mutex;								///<Mutex protecting fields below
+		std::condition_variable _start;					///<Signals workers that new task is given
+		std::condition_variable _finish;				///<Signals calling thread that worker finished
+		const std::function<void(uint)> *_task = nullptr;	///<Task being executed
+		uint _count = 0;								///<Number of task indices
+		std::atomic<uint> _next;						///<Next index to be executed
+		uint _generation = 0;							///<Number of tasks given
+		uint _running = 0;								///<Number of workers executing task
+		bool _exit = false;								///<Indicator if workers need to exit
+
+		void _work() noexcept;							///<Worker's loop
+		void _execute() noexcept;						///<Executes indices until they run out
+
+	public:
+		ThreadPool(uint threads);						///<Creates pool with given number of threads including calling one, 0 means hardware concurrency
+		uint thread_count() const noexcept;				///<Returns number of threads including calling one
+		void run(uint count, const std::function<void(uint)> &task) noexcept;	///<Calls task(0) ... task(count - 1) and waits for them, task must not throw or call run
+		~ThreadPool() noexcept;							///<Stops threads
+	};
+}
+
+#endif
@@ -0,0 +1,85 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#ifndef P6_TRACE
+#define P6_TRACE
+
+#include "p6_common.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace p6
+{
+	///Recorder of timed spans of solver phases, exported as Chrome trace. Spans are placed with P6_TRACE_SCOPE, which is compiled out unless library is built with P6_TRACE_ENABLED
+	class Trace
+	{
+	public:
+		static const uint counter_count = 3;	///<Number of hardware counters: CPU cycles, last level cache misses, mispredicted branches
+
+		///Span measured from construction to destruction
+		class Scope
+		{
+		private:
+			const char *_name;					///<Name of span, static string
+			std::chrono::steady_clock::time_point _begin;	///<Time of beginning
+			std::uint64_t _counter[counter_count];	///<Counters at beginning
+			bool _active;						///<Indicator if tracing was enabled at beginning
+
+		public:
+			Scope(const char *name) noexcept;	///<Begins span, name must be static string
+			~Scope() noexcept;					///<Ends span and records it
+		};
+
+	private:
+		///Recorded span
+		struct Span
+		{
+			const char *name;				///<Name of span
+			real begin;						///<Time of beginning in microseconds since tracing was enabled
+			real duration;					///<Duration in microseconds
+			uint thread;					///<Index of thread
+			bool counted;					///<Indicator if counters are valid
+			std::uint64_t counter[counter_count];	///<Counter differences
+		};
+
+		//Spans are coarse (phases of Newton iterations), so they are collected under one mutex
+		static std::mutex _mutex;						///<Mutex protecting fields below
+		static std::vector<Span> _span;					///<Recorded spans
+		static std::vector<std::thread::id> _thread;	///<Threads that recorded spans
+		static std::chrono::steady_clock::time_point _origin;	///<Time when tracing was enabled
+		static std::atomic<bool> _enabled;				///<Indicator if spans are recorded
+		static std::atomic<bool> _counters;				///<Indicator if hardware counters are read
+
+		static bool _read_counters(std::uint64_t counter[counter_count]) noexcept;	///<Reads counters of calling thread, returns false if they are not available
+		static void _record(const char *name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end, const std::uint64_t *counter) noexcept;	///<Records span
+
+	public:
+		static bool compiled() noexcept;		///<Returns if library is built with spans
+		static void enable(bool counters);		///<Starts recording spans, with hardware counters (Linux only) if counters is true, clears recorded spans
+		static void disable() noexcept;			///<Stops recording spans
+		static bool enabled() noexcept;			///<Returns if spans are recorded
+		static uint get_span_count() noexcept;	///<Returns number of recorded spans
+		static void write(const String filepath);	///<Writes recorded spans as Chrome trace JSON (chrome://tracing, Perfetto)
+	};
+}
+
+#ifdef P6_TRACE_ENABLED
+	#define P6_TRACE_CONCATENATE_(a, b) a##b
+	#define P6_TRACE_CONCATENATE(a, b) P6_TRACE_CONCATENATE_(a, b)
+	#define P6_TRACE_SCOPE(name) p6::Trace::Scope P6_TRACE_CONCATENATE(p6_trace_scope_, __LINE__)(name)
+#else
+	#define P6_TRACE_SCOPE(name)
+#endif
+
+#endif
@@ -0,0 +1,108 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#include "../header/p6_async_simulation.hpp"
+#include <cassert>
+#include <stdexcept>
+
+p6::AsyncSimulation::AsyncSimulation(Construction *construction, real timeout) : _construction(construction), _has_deadline(timeout > 0.0), _cancel(false)
+{
+	if (_has_deadline)
+	{
+		_deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<real>(timeout));
+	}
+	assert(_construction->_async == nullptr);
+	_construction->_async = this;
+	_thread = std::thread([this]() { _run(); });
+}
+
+void p6::AsyncSimulation::_run() noexcept
+{
+	Status status = Status::converged;
+	String error;
+	try
+	{
+		_construction->simulate(true);
+	}
+	catch (std::exception &e)
+	{
+		status = Status::failed;
+		error = e.what();
+	}
+	catch (...)
+	{
+		status = Status::failed;
+		error = "Unknown error";
+	}
+	if (status == Status::failed && _cancel) { status = Status::cancelled; error = "Simulation is cancelled"; }
+	else if (status == Status::failed && _stopped()) { status = Status::timed_out; error = "Simulation exceeded deadline"; }
+	_construction->_async = nullptr;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_status = status;
+	_error = error;
+	_finish.notify_all();
+}
+
+bool p6::AsyncSimulation::_stopped() const noexcept
+{
+	return _cancel || (_has_deadline && std::chrono::steady_clock::now() > _deadline);
+}
+
+void p6::AsyncSimulation::_update(const Construction::SimulationIteration *iteration, uint iterations, real tolerance) noexcept
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_progress.iteration = iterations;
+	_progress.increment = iteration->increment;
+	_progress.load = iteration->load;
+	_progress.max_residual = iteration->max_residual;
+	_progress.tolerance = tolerance;
+}
+
+p6::AsyncSimulation::Status p6::AsyncSimulation::get_status() const noexcept
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _status;
+}
+
+p6::AsyncSimulation::Progress p6::AsyncSimulation::get_progress() const noexcept
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _progress;
+}
+
+p6::String p6::AsyncSimulation::get_error() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _error;
+}
+
+void p6::AsyncSimulation::cancel() noexcept
+{
+	_cancel = true;
+}
+
+bool p6::AsyncSimulation::wait_for(real seconds)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	return _finish.wait_for(lock, std::chrono::duration<real>(seconds), [this]() { return _status != Status::running; });
+}
+
+void p6::AsyncSimulation::wait()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_finish.wait(lock, [this]() { return _status != Status::running; });
+}
+
+p6::AsyncSimulation::~AsyncSimulation() noexcept
+{
+	_cancel = true;
+	if (_thread.joinable()) _thread.join();
+}
@@ -9,40 +9,24 @@
 */
 
 #include "../header/p6_construction.hpp"
+#include "../header/p6_async_simulation.hpp"
 #include "../header/p6_linear_material.hpp"
 #include "../header/p6_nonlinear_material.hpp"
 #include "../header/p6_file.hpp"
+#include "../header/p6_iterative_solver.hpp"
+#include "../header/p6_linear_solver.hpp"
+#include "../header/p6_matrix.hpp"
+#include "../header/p6_stick_kernel.hpp"
+#include "../header/p6_thread_pool.hpp"
+#include "../header/p6_trace.hpp"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
-#include <Eigen/Dense>
-#include <Eigen/Sparse>
-#include <Eigen/SparseLU>
-
-namespace p6
-{
-	class DenseVector : public Eigen::Matrix<p6::real, Eigen::Dynamic, 1>
-	{
-	public:
-		using Eigen::Matrix<p6::real, Eigen::Dynamic, 1>::Matrix;
-	};
-
-	class DenseMatrix : public Eigen::Matrix<p6::real, Eigen::Dynamic, Eigen::Dynamic>
-	{
-	public:
-		using Eigen::Matrix<p6::real, Eigen::Dynamic, Eigen::Dynamic>::Matrix;
-	};
-
-	class SparseMatrix : public Eigen::SparseMatrix<p6::real>
-	{
-	public:
-		using Eigen::SparseMatrix<p6::real>::SparseMatrix;
-	};
-
-	class TripletVector : public std::vector<Eigen::Triplet<p6::real>>
-	{
-	public:
-		using std::vector<Eigen::Triplet<p6::real>>::vector;
-	};
-}
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <memory>
 
 p6::uint p6::Construction::create_node() noexcept
 {
@@ -87,6 +71,7 @@ void p6::Construction::set_node_coord(uint node, Coord coord) noexcept
 	assert(coord.y == coord.y);
 	assert(abs(coord.y) != std::numeric_limits<real>::infinity());
 	_node[node].coord = coord;
+	_node[node].warm = false;
 }
 
 void p6::Construction::set_node_freedom(uint node, unsigned char freedom) noexcept
@@ -94,6 +79,7 @@ void p6::Construction::set_node_freedom(uint node, unsigned char freedom) noexce
 	assert(!_simulation);
 	assert(freedom <= 2);
 	_node[node].freedom = freedom;
+	_node[node].warm = false;
 }
 
 void p6::Construction::set_node_rail_vector(uint node, Coord vector) noexcept
@@ -104,6 +90,7 @@ void p6::Construction::set_node_rail_vector(uint node, Coord vector) noexcept
 	assert(vector.y == vector.y);
 	assert(abs(vector.y) != std::numeric_limits<real>::infinity());
 	_node[node].vector = vector;
+	_node[node].warm = false;
 }
 
 p6::uint p6::Construction::get_node_count() const noexcept
@@ -126,6 +113,22 @@ p6::Coord p6::Construction::get_node_rail_vector(uint node) const noexcept
 	return _node[node].vector;
 }
 
+void p6::Construction::set_node_tracked(uint node, bool tracked) noexcept
+{
+	_node[node].tracked = tracked;
+}
+
+bool p6::Construction::get_node_tracked(uint node) const noexcept
+{
+	return _node[node].tracked;
+}
+
+p6::Coord p6::Construction::get_node_path(uint node, uint point) const noexcept
+{
+	assert(_node[node].tracked);
+	return _node[node].path[point];
+}
+
 p6::uint p6::Construction::create_stick(const uint node[2]) noexcept
 {
 	assert(!_simulation);
@@ -154,6 +157,40 @@ void p6::Construction::delete_stick(uint stick) noexcept
 	_stick.erase(_stick.begin() + stick);
 }
 
+void p6::Construction::create_sticks(const std::vector<uint> *node, uint material, real area) noexcept
+{
+	assert(!_simulation);
+	assert(node->size() % 2 == 0);
+	assert(material < _material.size());
+	assert(area == area);
+	_stick.reserve(_stick.size() + node->size() / 2);
+	for (uint i = 0; i < node->size(); i += 2)
+	{
+		assert(node->at(i) != node->at(i + 1));
+		assert(node->at(i) < _node.size());
+		assert(node->at(i + 1) < _node.size());
+		Stick stick;
+		stick.node[0] = node->at(i);
+		stick.node[1] = node->at(i + 1);
+		stick.material = material;
+		stick.area = area;
+		_stick.push_back(stick);
+	}
+}
+
+void p6::Construction::delete_sticks(const std::vector<uint> *stick) noexcept
+{
+	assert(!_simulation);
+	uint kept = 0, deleted = 0;
+	for (uint i = 0; i < _stick.size(); i++)
+	{
+		if (deleted < stick->size() && stick->at(deleted) == i) { deleted++; continue; }
+		_stick[kept++] = _stick[i];
+	}
+	assert(deleted == stick->size());
+	_stick.resize(kept);
+}
+
 void p6::Construction::set_stick_material(uint stick, uint material) noexcept
 {
 	assert(!_simulation);
@@ -399,6 +436,7 @@ void p6::Construction::load(const String filepath)
 	for (uint i = 0; i < _node.size(); i++)
 	{
 		file.read(&_node[i], sizeof(StaticNode));
+		_node[i].warm = false;
 	}
 
 	//Sticks
@@ -467,6 +505,7 @@ void p6::Construction::import(const String filepath)
 	for (uint i = old_node_size; i < _node.size(); i++)
 	{
 		file.read(&_node[i], sizeof(StaticNode));
+		_node[i].warm = false;
 	}
 
 	//Sticks
@@ -553,27 +592,108 @@ void p6::Construction::_check_materials_specified() const
 	}
 }
 
-unsigned int p6::Construction::_create_map(std::vector<uint> *map) noexcept
+unsigned int p6::Construction::_create_map(std::vector<uint> *map) const noexcept
 {
-	map->resize(_node.size(), (uint)-1);
+	P6_TRACE_SCOPE("create_map");
+	map->assign(_node.size(), (uint)-1);
+	std::vector<uint> order;
+	if (_renumbering) _create_ordering(&order);
+	else for (uint i = 0; i < _node.size(); i++) { if (_node[i].freedom != 0) order.push_back(i); }
 	unsigned int freedom = 0;
-	for (uint i = 0; i < _node.size(); i++)
+	for (uint i = 0; i < order.size(); i++)
 	{
-		if (_node[i].freedom == 1) { map->at(i) = freedom; freedom += 1; }
-		else if (_node[i].freedom == 2) { map->at(i) = freedom; freedom += 2; }
+		map->at(order[i]) = freedom;
+		freedom += _node[order[i]].freedom;
 	}
 	return freedom;
 }
 
-p6::real p6::Construction::_find_smallest_force() const noexcept
+void p6::Construction::_create_ordering(std::vector<uint> *order) const noexcept
 {
-	if (_force.empty()) return 0.0;
-	real force = std::numeric_limits<real>::infinity();
-	for (uint i = 0; i < _force.size(); i++)
+	//Neighbors of non-fixed nodes, fixed nodes do not couple equations
+	std::vector<uint> offset(_node.size() + 1, 0);
+	for (uint i = 0; i < _stick.size(); i++)
+	{
+		const uint *node = _stick[i].node;
+		if (_node[node[0]].freedom == 0 || _node[node[1]].freedom == 0) continue;
+		offset[node[0] + 1]++;
+		offset[node[1] + 1]++;
+	}
+	for (uint i = 0; i < _node.size(); i++) offset[i + 1] += offset[i];
+	std::vector<uint> neighbor(offset[_node.size()]);
+	std::vector<uint> position(offset.begin(), offset.end() - 1);
+	for (uint i = 0; i < _stick.size(); i++)
+	{
+		const uint *node = _stick[i].node;
+		if (_node[node[0]].freedom == 0 || _node[node[1]].freedom == 0) continue;
+		neighbor[position[node[0]]++] = node[1];
+		neighbor[position[node[1]]++] = node[0];
+	}
+	for (uint i = 0; i < _node.size(); i++)
+	{
+		std::sort(neighbor.begin() + offset[i], neighbor.begin() + offset[i + 1], [&](uint a, uint b)
+		{
+			const uint degree_a = offset[a + 1] - offset[a], degree_b = offset[b + 1] - offset[b];
+			return (degree_a != degree_b) ? (degree_a < degree_b) : (a < b);
+		});
+	}
+
+	//Breadth-first search visiting neighbors in order of increasing degree gives Cuthill-McKee order
+	std::vector<uint> level(_node.size(), (uint)-1);
+	auto search = [&](uint start, std::vector<uint> *queue, std::vector<uint> *queue_level)
+	{
+		queue->assign(1, start);
+		level[start] = 0;
+		for (uint q = 0; q < queue->size(); q++)
+		{
+			const uint node = queue->at(q);
+			for (uint j = offset[node]; j < offset[node + 1]; j++)
+			{
+				if (level[neighbor[j]] != (uint)-1) continue;
+				level[neighbor[j]] = level[node] + 1;
+				queue->push_back(neighbor[j]);
+			}
+		}
+		queue_level->resize(queue->size());
+		for (uint q = 0; q < queue->size(); q++) { queue_level->at(q) = level[queue->at(q)]; level[queue->at(q)] = (uint)-1; }
+	};
+
+	//Every component starts from pseudo-peripheral node: node of smallest degree in the last level is taken while depth grows
+	order->clear();
+	std::vector<unsigned char> visited(_node.size(), 0);
+	std::vector<uint> queue, queue_level, candidate_queue, candidate_level;
+	for (uint i = 0; i < _node.size(); i++)
+	{
+		if (_node[i].freedom == 0 || visited[i]) continue;
+		search(i, &queue, &queue_level);
+		while (true)
+		{
+			const uint depth = queue_level.back();
+			uint candidate = queue.back();
+			for (uint q = queue.size() - 1; q != (uint)-1 && queue_level[q] == depth; q--)
+			{
+				if (offset[queue[q] + 1] - offset[queue[q]] < offset[candidate + 1] - offset[candidate]) candidate = queue[q];
+			}
+			search(candidate, &candidate_queue, &candidate_level);
+			if (candidate_level.back() <= depth) break;
+			queue.swap(candidate_queue);
+			queue_level.swap(candidate_level);
+		}
+		for (uint q = 0; q < queue.size(); q++) visited[queue[q]] = 1;
+		order->insert(order->end(), queue.begin(), queue.end());
+	}
+	std::reverse(order->begin(), order->end());
+}
+
+p6::real p6::Construction::_find_smallest_force(const std::vector<Force> *force) const noexcept
+{
+	if (force->empty()) return 0.0;
+	real smallest = std::numeric_limits<real>::infinity();
+	for (uint i = 0; i < force->size(); i++)
 	{
-		if (force > _force[i].direction.norm()) force = _force[i].direction.norm();
+		if (smallest > force->at(i).direction.norm()) smallest = force->at(i).direction.norm();
 	}
-	return force;
+	return smallest;
 }
 
 void p6::Construction::_copy_state() noexcept
@@ -581,22 +701,49 @@ void p6::Construction::_copy_state() noexcept
 	for (uint i = 0; i < _node.size(); i++) _node[i].coord_simulated = _node[i].coord;
 }
 
-void p6::Construction::_create_state(
+bool p6::Construction::_create_state(
 	const std::vector<uint> *map,
-	DenseVector *state) noexcept
+	const Assembly *assembly,
+	bool warm,
+	DenseVector *state) const noexcept
 {
+	P6_TRACE_SCOPE("create_state");
+	//Nodes that were not simulated yet are moved with average displacement of simulated neighbors
+	bool used = false;
 	for (uint i = 0; i < _node.size(); i++)
 	{
+		if (_node[i].freedom == 0) continue;
+		Coord displacement;
+		if (warm && _node[i].warm)
+		{
+			displacement = _node[i].coord_simulated - _node[i].coord;
+			used = true;
+		}
+		else if (warm)
+		{
+			uint count = 0;
+			for (uint j = assembly->node_stick_offset[i]; j < assembly->node_stick_offset[i + 1]; j++)
+			{
+				const uint *node = _stick[assembly->node_stick[j] / 2].node;
+				const uint neighbor = node[1 - assembly->node_stick[j] % 2];
+				if (!_node[neighbor].warm) continue;
+				displacement = displacement + (_node[neighbor].coord_simulated - _node[neighbor].coord);
+				count++;
+			}
+			if (count > 0) displacement = displacement / count;
+		}
+
 		if (_node[i].freedom == 1)
 		{
-			(*state)(map->at(i)) = 0.0;
+			(*state)(map->at(i)) = displacement.dot(_node[i].vector) / _node[i].vector.norm();
 		}
-		else if (_node[i].freedom == 2)
+		else
 		{
-			(*state)(map->at(i)    ) = _node[i].coord.x;
-			(*state)(map->at(i) + 1) = _node[i].coord.y;
+			(*state)(map->at(i)    ) = _node[i].coord.x + displacement.x;
+			(*state)(map->at(i) + 1) = _node[i].coord.y + displacement.y;
 		}
 	}
+	return used;
 }
 
 void p6::Construction::_apply_state(
@@ -615,224 +762,1464 @@ void p6::Construction::_apply_state(
 			_node[i].coord_simulated = Coord((*state)(map->at(i)), (*state)(map->at(i) + 1));
 		}
 		else _node[i].coord_simulated = _node[i].coord;
+		_node[i].warm = true;
 	}
 }
 
-void p6::Construction::_fill_derivative_and_residual(
+void p6::Construction::_record_path(
 	const std::vector<uint> *map,
 	const DenseVector *state,
-	TripletVector *buffer,
-	DenseVector *residual,
-	SparseMatrix *derivative) noexcept
+	real load_factor) noexcept
 {
-	//Setting residual  and derivative to zero
-	residual->setZero();
-	buffer->resize(0);
+	_path_load.push_back(load_factor);
+	for (uint i = 0; i < _node.size(); i++)
+	{
+		if (_node[i].tracked) _node[i].path.push_back(_get_coord(i, map, state) - _node[i].coord);
+	}
+}
 
-	//Summing external forces
-	for (uint i = 0; i < _force.size(); i++)
+unsigned int p6::Construction::_get_basis(uint node, Coord basis[2]) const noexcept
+{
+	if (_node[node].freedom == 1)
 	{
-		uint node = _force[i].node;
-		if (_node[node].freedom == 1)
-		{
-			Coord rail_vector = _node[node].vector / _node[node].vector.norm();
-			(*residual)(map->at(node)) += _force[i].direction.dot(rail_vector);
-		}
-		else if (_node[node].freedom == 2)
+		basis[0] = _node[node].vector / _node[node].vector.norm();
+		return 1;
+	}
+	else if (_node[node].freedom == 2)
+	{
+		basis[0] = Coord(1.0, 0.0);
+		basis[1] = Coord(0.0, 1.0);
+		return 2;
+	}
+	else return 0;
+}
+
+p6::Coord p6::Construction::_get_coord(uint node, const std::vector<uint> *map, const DenseVector *state) const noexcept
+{
+	if (_node[node].freedom == 1) return _node[node].coord + _node[node].vector * (*state)(map->at(node)) / _node[node].vector.norm();
+	else if (_node[node].freedom == 2) return Coord((*state)(map->at(node)), (*state)(map->at(node) + 1));
+	else return _node[node].coord;
+}
+
+void p6::Construction::_create_pattern(
+	const std::vector<uint> *map,
+	SparseMatrix *derivative,
+	Assembly *assembly) const noexcept
+{
+	//Creating structure with zeros
+	TripletVector buffer;
+	assembly->slot_offset.resize(_stick.size() + 1);
+	for (uint i = 0; i < _stick.size(); i++)
+	{
+		assembly->slot_offset[i] = buffer.size();
+		const uint *node = _stick[i].node;
+		Coord basis[2][2];
+		unsigned int dimension[2] = { _get_basis(node[0], basis[0]), _get_basis(node[1], basis[1]) };
+		for (uint a = 0; a < 2; a++) for (uint k = 0; k < dimension[a]; k++)
 		{
-			(*residual)(map->at(node)    ) += _force[i].direction.x;
-			(*residual)(map->at(node) + 1) += _force[i].direction.y;
+			for (uint b = 0; b < 2; b++) for (uint l = 0; l < dimension[b]; l++)
+			{
+				buffer.push_back(Eigen::Triplet<real>(map->at(node[a]) + k, map->at(node[b]) + l, 0.0));
+			}
 		}
 	}
+	assembly->slot_offset[_stick.size()] = buffer.size();
+	derivative->setFromTriplets(buffer.begin(), buffer.end());
+	derivative->makeCompressed();
+
+	//Finding value slots in the same order
+	assembly->slot.resize(buffer.size());
+	const int *outer = derivative->outerIndexPtr();
+	const int *inner = derivative->innerIndexPtr();
+	for (uint i = 0; i < buffer.size(); i++)
+	{
+		const int *begin = inner + outer[buffer[i].col()];
+		const int *end = inner + outer[buffer[i].col() + 1];
+		assembly->slot[i] = std::lower_bound(begin, end, buffer[i].row()) - inner;
+	}
+}
+
+const p6::uint p6::Construction::_max_chunk;
 
-	//Summing self-derivatives and setting other-derivatives
+void p6::Construction::_create_colors(Assembly *assembly) const noexcept
+{
+	//Greedy coloring, colors used by node's sticks are stored per node
+	std::vector<std::vector<uint>> node_colors(_node.size());
+	std::vector<uint> stick_color(_stick.size());
+	std::vector<uint> color_size;
 	for (uint i = 0; i < _stick.size(); i++)
 	{
-		//Calculating essentials
 		const uint *node = _stick[i].node;
-		Coord delta;
+		uint color = 0;
+		while (true)
 		{
-			Coord coord[2];
-			for (uint j = 0; j < 2; j++)
+			bool used = false;
+			for (uint j = 0; j < 2 && !used; j++)
 			{
-				if (_node[node[j]].freedom == 1) coord[j] = _node[node[j]].coord + _node[node[j]].vector * (*state)(map->at(node[j])) / _node[node[j]].vector.norm();
-				else if (_node[node[j]].freedom == 2) coord[j] = Coord((*state)(map->at(node[j])), (*state)(map->at(node[j]) + 1));
-				else coord[j] = _node[node[j]].coord;
+				const std::vector<uint> &colors = node_colors[node[j]];
+				used = std::find(colors.begin(), colors.end(), color) != colors.end();
 			}
-			delta = coord[1] - coord[0];
+			if (!used) break;
+			color++;
+		}
+		for (uint j = 0; j < 2; j++)
+		{
+			if (_node[node[j]].freedom != 0) node_colors[node[j]].push_back(color);
+		}
+		stick_color[i] = color;
+		if (color_size.size() <= color) color_size.resize(color + 1, 0);
+		color_size[color]++;
+	}
+
+	//Sorting sticks by color, keeping original order inside color
+	assembly->color_offset.resize(color_size.size() + 1);
+	assembly->color_offset[0] = 0;
+	for (uint i = 0; i < color_size.size(); i++) assembly->color_offset[i + 1] = assembly->color_offset[i] + color_size[i];
+	std::vector<uint> position(assembly->color_offset.begin(), assembly->color_offset.end() - 1);
+	assembly->color.resize(_stick.size());
+	for (uint i = 0; i < _stick.size(); i++) assembly->color[position[stick_color[i]]++] = i;
+
+	//Grouping sticks of every color by freedom classes and linearity and splitting groups into chunks, every chunk runs one specialized kernel.
+	//Sticks of one color never write to the same element, so order inside color does not change results
+	std::vector<unsigned char> stick_class(_stick.size());
+	for (uint i = 0; i < _stick.size(); i++)
+	{
+		const bool linear = _material[_stick[i].material]->type() == Material::Type::linear;
+		stick_class[i] = 2 * (3 * _node[_stick[i].node[0]].freedom + _node[_stick[i].node[1]].freedom) + (linear ? 0 : 1);
+	}
+	assembly->chunk_offset.clear();
+	assembly->chunk_class.clear();
+	assembly->chunk_linear.clear();
+	assembly->color_chunk_offset.resize(color_size.size() + 1);
+	for (uint c = 0; c < color_size.size(); c++)
+	{
+		const uint begin = assembly->color_offset[c];
+		const uint end = assembly->color_offset[c + 1];
+		std::stable_sort(assembly->color.begin() + begin, assembly->color.begin() + end, [&](uint a, uint b) { return stick_class[a] < stick_class[b]; });
+		assembly->color_chunk_offset[c] = assembly->chunk_class.size();
+		for (uint i = begin; i < end; )
+		{
+			const unsigned char group = stick_class[assembly->color[i]];
+			assembly->chunk_offset.push_back(i);
+			assembly->chunk_class.push_back(group / 2);
+			assembly->chunk_linear.push_back((group % 2 == 0) ? 1 : 0);
+			const uint chunk_end = (end - i > _max_chunk) ? (i + _max_chunk) : end;
+			while (i < chunk_end && stick_class[assembly->color[i]] == group) i++;
+		}
+	}
+	assembly->color_chunk_offset[color_size.size()] = assembly->chunk_class.size();
+	assembly->chunk_offset.push_back(_stick.size());
+}
+
+void p6::Construction::_create_adjacency(Assembly *assembly) const noexcept
+{
+	//Sticks of every node, counting sort keeps sticks in original order
+	assembly->node_stick_offset.assign(_node.size() + 1, 0);
+	for (uint i = 0; i < _stick.size(); i++)
+	{
+		for (uint j = 0; j < 2; j++) assembly->node_stick_offset[_stick[i].node[j] + 1]++;
+	}
+	for (uint i = 0; i < _node.size(); i++) assembly->node_stick_offset[i + 1] += assembly->node_stick_offset[i];
+	std::vector<uint> position(assembly->node_stick_offset.begin(), assembly->node_stick_offset.end() - 1);
+	assembly->node_stick.resize(2 * _stick.size());
+	for (uint i = 0; i < _stick.size(); i++)
+	{
+		for (uint j = 0; j < 2; j++) assembly->node_stick[position[_stick[i].node[j]]++] = 2 * i + j;
+	}
+}
+
+void p6::Construction::_create_model(const std::vector<uint> *map, Assembly *assembly) const noexcept
+{
+	//Everything the Newton loop needs is gathered into flat arrays once per simulation
+	assembly->index.resize(2 * _stick.size());
+	assembly->freedom.resize(2 * _stick.size());
+	assembly->origin.resize(2 * _stick.size());
+	assembly->rail.resize(2 * _stick.size());
+	assembly->initial_length.resize(_stick.size());
+	assembly->area.resize(_stick.size());
+	assembly->material.resize(_stick.size());
+	assembly->modulus.resize(_stick.size());
+	for (uint i = 0; i < _stick.size(); i++)
+	{
+		for (uint j = 0; j < 2; j++)
+		{
+			const Node &node = _node[_stick[i].node[j]];
+			assembly->index[2 * i + j] = map->at(_stick[i].node[j]);
+			assembly->freedom[2 * i + j] = node.freedom;
+			assembly->origin[2 * i + j] = node.coord;
+			assembly->rail[2 * i + j] = node.vector / node.vector.norm();
 		}
-		const Material *material = _material[_stick[i].material];
+		assembly->initial_length[i] = (_node[_stick[i].node[0]].coord - _node[_stick[i].node[1]].coord).norm();
+		assembly->area[i] = _stick[i].area;
+		assembly->material[i] = _material[_stick[i].material];
+		assembly->modulus[i] = (assembly->material[i]->type() == Material::Type::linear) ? static_cast<const LinearMaterial*>(assembly->material[i])->modulus() : 0.0;
+	}
+	assembly->node_index = *map;
+	assembly->node_freedom.resize(_node.size());
+	assembly->node_rail.resize(_node.size());
+	for (uint i = 0; i < _node.size(); i++)
+	{
+		assembly->node_freedom[i] = _node[i].freedom;
+		assembly->node_rail[i] = _node[i].vector / _node[i].vector.norm();
+	}
+}
+
+void p6::Construction::_create_load(const std::vector<uint> *map, const std::vector<Force> *force, DenseVector *load) const noexcept
+{
+	load->setZero();
+	for (uint i = 0; i < force->size(); i++)
+	{
+		uint node = force->at(i).node;
+		Coord basis[2];
+		unsigned int dimension = _get_basis(node, basis);
+		for (uint k = 0; k < dimension; k++) (*load)(map->at(node) + k) -= force->at(i).direction.dot(basis[k]);
+	}
+}
+
+p6::Coord p6::Construction::_get_side_coord(const Assembly *assembly, uint side, const DenseVector *state) const noexcept
+{
+	if (assembly->freedom[side] == 2) return Coord((*state)(assembly->index[side]), (*state)(assembly->index[side] + 1));
+	else if (assembly->freedom[side] == 1) return assembly->origin[side] + assembly->rail[side] * (*state)(assembly->index[side]);
+	else return assembly->origin[side];
+}
+
+unsigned int p6::Construction::_get_side_basis(const Assembly *assembly, uint side, Coord basis[2]) const noexcept
+{
+	if (assembly->freedom[side] == 2)
+	{
+		basis[0] = Coord(1.0, 0.0);
+		basis[1] = Coord(0.0, 1.0);
+	}
+	else if (assembly->freedom[side] == 1) basis[0] = assembly->rail[side];
+	return assembly->freedom[side];
+}
+
+
+template<unsigned char F> p6::Coord p6::Construction::_get_side_coord(const Assembly *assembly, uint side, const DenseVector *state) const noexcept
+{
+	if (F == 2) return Coord((*state)(assembly->index[side]), (*state)(assembly->index[side] + 1));
+	else if (F == 1) return assembly->origin[side] + assembly->rail[side] * (*state)(assembly->index[side]);
+	else return assembly->origin[side];
+}
+
+template<unsigned char F> unsigned int p6::Construction::_get_side_basis(const Assembly *assembly, uint side, Coord basis[2]) const noexcept
+{
+	if (F == 2)
+	{
+		basis[0] = Coord(1.0, 0.0);
+		basis[1] = Coord(0.0, 1.0);
+	}
+	else if (F == 1) basis[0] = assembly->rail[side];
+	return F;
+}
+
+template<unsigned char F0, unsigned char F1> void p6::Construction::_evaluate_chunk(
+	uint chunk,
+	const DenseVector *state,
+	const Assembly *assembly,
+	bool stiffness,
+	Evaluation *evaluation) const noexcept
+{
+	//Gathering sticks' vectors
+	const uint begin = assembly->chunk_offset[chunk];
+	const uint count = assembly->chunk_offset[chunk + 1] - begin;
+	assert(count <= _max_chunk);
+	for (uint j = 0; j < count; j++)
+	{
+		const uint side = 2 * assembly->color[begin + j];
+		Coord delta = _get_side_coord<F1>(assembly, side + 1, state) - _get_side_coord<F0>(assembly, side, state);
+		evaluation->dx[j] = delta.x;
+		evaluation->dy[j] = delta.y;
+	}
+
+	//Linear sticks are evaluated with vector instructions
+	if (assembly->chunk_linear[chunk] != 0)
+	{
+		StickKernel::Batch batch;
+		batch.count = count;
+		batch.stick = assembly->color.data() + begin;
+		batch.dx = evaluation->dx;
+		batch.dy = evaluation->dy;
+		batch.initial_length = assembly->initial_length.data();
+		batch.area = assembly->area.data();
+		batch.modulus = assembly->modulus.data();
+		batch.ex = evaluation->ex;
+		batch.ey = evaluation->ey;
+		batch.length = evaluation->length;
+		batch.tension = evaluation->tension;
+		batch.kxx = stiffness ? evaluation->kxx : nullptr;
+		batch.kxy = stiffness ? evaluation->kxy : nullptr;
+		batch.kyy = stiffness ? evaluation->kyy : nullptr;
+		StickKernel::evaluate(&batch);
+		return;
+	}
+
+	//Non-linear sticks are evaluated one by one: the force acting on the first node is T * e, its derivative by the
+	//first node's coordinates is -K = -(T' * e * e^T + T / L * (I - e * e^T)), by the second node's is K
+	for (uint j = 0; j < count; j++)
+	{
+		const uint stick = assembly->color[begin + j];
+		Coord delta(evaluation->dx[j], evaluation->dy[j]);
 		real length = delta.norm();
-		real initial_length = (_node[node[0]].coord - _node[node[1]].coord).norm();
-		real tension = _stick[i].area * material->stress((length - initial_length) / initial_length);
+		real initial_length = assembly->initial_length[stick];
+		real stress, stress_derivative;
+		assembly->material[stick]->evaluate((length - initial_length) / initial_length, &stress, &stress_derivative);
+		real tension = assembly->area[stick] * stress;
+		Coord direction = delta / length;
+		evaluation->ex[j] = direction.x;
+		evaluation->ey[j] = direction.y;
+		evaluation->length[j] = length;
+		evaluation->tension[j] = tension;
+		if (!stiffness) continue;
+		real dtension = assembly->area[stick] * stress_derivative / initial_length;
+		if (dtension == 0.0) dtension = assembly->area[stick] / initial_length; //Zero stiffness would make derivative singular
+		evaluation->kxx[j] = dtension * direction.x * direction.x + tension / length * (1.0 - direction.x * direction.x);
+		evaluation->kxy[j] = dtension * direction.x * direction.y - tension / length * direction.x * direction.y;
+		evaluation->kyy[j] = dtension * direction.y * direction.y + tension / length * (1.0 - direction.y * direction.y);
+	}
+}
 
+template<unsigned char F0, unsigned char F1> void p6::Construction::_fill_chunk(
+	uint chunk,
+	const DenseVector *state,
+	const Assembly *assembly,
+	DenseVector *residual,
+	real *values,
+	std::vector<real> *stiffness) const noexcept
+{
+	Evaluation evaluation;
+	_evaluate_chunk<F0, F1>(chunk, state, assembly, values != nullptr || stiffness != nullptr, &evaluation);
+	const uint begin = assembly->chunk_offset[chunk];
+	const uint count = assembly->chunk_offset[chunk + 1] - begin;
+	for (uint j = 0; j < count; j++)
+	{
 		//Summing residual
+		const uint stick = assembly->color[begin + j];
+		const uint side = 2 * stick;
+		const real tension = evaluation.tension[j];
+		Coord stick_vector(evaluation.ex[j], evaluation.ey[j]);
+		if (F0 == 1)
+		{
+			(*residual)(assembly->index[side]) -= tension * stick_vector.dot(assembly->rail[side]);
+		}
+		else if (F0 == 2)
+		{
+			(*residual)(assembly->index[side]    ) -= tension * stick_vector.x;
+			(*residual)(assembly->index[side] + 1) -= tension * stick_vector.y;
+		}
+		if (F1 == 1)
+		{
+			(*residual)(assembly->index[side + 1]) += tension * stick_vector.dot(assembly->rail[side + 1]);
+		}
+		else if (F1 == 2)
+		{
+			(*residual)(assembly->index[side + 1]    ) += tension * stick_vector.x;
+			(*residual)(assembly->index[side + 1] + 1) += tension * stick_vector.y;
+		}
+
+		//Summing derivative
+		if (values == nullptr && stiffness == nullptr) continue;
+		const real kxx = evaluation.kxx[j];
+		const real kxy = evaluation.kxy[j];
+		const real kyy = evaluation.kyy[j];
+		if (stiffness != nullptr) { real *s = stiffness->data() + 3 * stick; s[0] = kxx; s[1] = kxy; s[2] = kyy; }
+		if (values == nullptr) continue;
+		Coord basis[2][2];
+		const unsigned int dimension[2] = { _get_side_basis<F0>(assembly, side, basis[0]), _get_side_basis<F1>(assembly, side + 1, basis[1]) };
+		const uint *slot = assembly->slot.data() + assembly->slot_offset[stick];
+		for (uint a = 0; a < 2; a++) for (uint k = 0; k < dimension[a]; k++)
+		{
+			Coord row = basis[a][k];
+			Coord row_stiffness(row.x * kxx + row.y * kxy, row.x * kxy + row.y * kyy);
+			for (uint b = 0; b < 2; b++) for (uint l = 0; l < dimension[b]; l++)
+			{
+				real value = row_stiffness.dot(basis[b][l]);
+				values[*slot++] += (a == b) ? value : -value;
+			}
+		}
+	}
+}
+
+template<unsigned char F0, unsigned char F1> void p6::Construction::_get_chunk_force(
+	uint chunk,
+	const DenseVector *state,
+	const Assembly *assembly,
+	std::vector<Coord> *force) const noexcept
+{
+	Evaluation evaluation;
+	_evaluate_chunk<F0, F1>(chunk, state, assembly, false, &evaluation);
+	const uint begin = assembly->chunk_offset[chunk];
+	const uint count = assembly->chunk_offset[chunk + 1] - begin;
+	for (uint j = 0; j < count; j++)
+	{
+		(*force)[assembly->color[begin + j]] = Coord(evaluation.dx[j], evaluation.dy[j]) * (evaluation.tension[j] / evaluation.length[j]);
+	}
+}
+
+void p6::Construction::_for_each_chunk(
+	const Assembly *assembly,
+	ThreadPool *pool,
+	const std::function<void(uint)> &function) const noexcept
+{
+	//Sticks of one color never write to the same element, so every element
+	//receives it's terms in color order independently of number of threads
+	for (uint c = 0; c + 1 < assembly->color_chunk_offset.size(); c++)
+	{
+		const uint begin = assembly->color_chunk_offset[c];
+		const uint chunks = assembly->color_chunk_offset[c + 1] - begin;
+		std::function<void(uint)> task = [&](uint t) { function(begin + t); };
+		if (pool != nullptr) pool->run(chunks, task);
+		else for (uint t = 0; t < chunks; t++) task(t);
+	}
+}
+
+void p6::Construction::_for_each_stick(
+	const Assembly *assembly,
+	ThreadPool *pool,
+	const std::function<void(uint)> &function) const noexcept
+{
+	_for_each_chunk(assembly, pool, [&](uint chunk)
+	{
+		for (uint i = assembly->chunk_offset[chunk]; i < assembly->chunk_offset[chunk + 1]; i++) function(assembly->color[i]);
+	});
+}
+
+void p6::Construction::_fill_derivative_and_residual(
+	const DenseVector *state,
+	const DenseVector *load,
+	const Assembly *assembly,
+	ThreadPool *pool,
+	DenseVector *residual,
+	SparseMatrix *derivative,
+	std::vector<real> *stiffness) const noexcept
+{
+	P6_TRACE_SCOPE("fill_derivative_and_residual");
+	//Residual is the negated sum of forces acting on nodes, so derivative is
+	//the stiffness matrix, which is positive definite for stable constructions
+	//Setting residual and derivative to zero
+	residual->setZero();
+	real *values = nullptr;
+	if (derivative != nullptr)
+	{
+		values = derivative->valuePtr();
+		std::fill(values, values + derivative->nonZeros(), 0.0);
+	}
+	if (stiffness != nullptr) stiffness->resize(3 * _stick.size());
+
+	//Summing external forces
+	*residual += *load;
+
+	//Summing sticks, kernel is specialized for freedoms of stick's nodes
+	typedef void (Construction::*Kernel)(uint, const DenseVector*, const Assembly*, DenseVector*, real*, std::vector<real>*) const;
+	static const Kernel kernel[9] =
+	{
+		&Construction::_fill_chunk<0, 0>, &Construction::_fill_chunk<0, 1>, &Construction::_fill_chunk<0, 2>,
+		&Construction::_fill_chunk<1, 0>, &Construction::_fill_chunk<1, 1>, &Construction::_fill_chunk<1, 2>,
+		&Construction::_fill_chunk<2, 0>, &Construction::_fill_chunk<2, 1>, &Construction::_fill_chunk<2, 2>
+	};
+	_for_each_chunk(assembly, pool, [&](uint chunk)
+	{
+		(this->*kernel[assembly->chunk_class[chunk]])(chunk, state, assembly, residual, values, stiffness);
+	});
+}
+
+p6::real p6::Construction::_get_residual(
+	const DenseVector *state,
+	const DenseVector *load,
+	const Assembly *assembly,
+	ThreadPool *pool,
+	std::vector<Coord> *force,
+	DenseVector *residual) const noexcept
+{
+	//Calculating forces acting on first nodes of sticks, every stick writes only it's own force, so all chunks run at once
+	typedef void (Construction::*Kernel)(uint, const DenseVector*, const Assembly*, std::vector<Coord>*) const;
+	static const Kernel kernel[9] =
+	{
+		&Construction::_get_chunk_force<0, 0>, &Construction::_get_chunk_force<0, 1>, &Construction::_get_chunk_force<0, 2>,
+		&Construction::_get_chunk_force<1, 0>, &Construction::_get_chunk_force<1, 1>, &Construction::_get_chunk_force<1, 2>,
+		&Construction::_get_chunk_force<2, 0>, &Construction::_get_chunk_force<2, 1>, &Construction::_get_chunk_force<2, 2>
+	};
+	const uint chunk = 256;
+	force->resize(assembly->area.size());
+	std::function<void(uint)> stick_task = [&](uint t)
+	{
+		(this->*kernel[assembly->chunk_class[t]])(t, state, assembly, force);
+	};
+	const uint stick_chunks = assembly->chunk_class.size();
+	if (pool != nullptr) pool->run(stick_chunks, stick_task);
+	else for (uint t = 0; t < stick_chunks; t++) stick_task(t);
+
+	//Gathering forces node by node, node's elements are final once it is processed, so maximum is found in the same pass
+	residual->resize(load->size());
+	const uint nodes = assembly->node_freedom.size();
+	const uint node_chunks = (nodes + chunk - 1) / chunk;
+	std::vector<real> chunk_maximum(node_chunks, 0.0);
+	std::function<void(uint)> node_task = [&](uint t)
+	{
+		const uint end = std::min((t + 1) * chunk, nodes);
+		real maximum = 0.0;
+		for (uint i = t * chunk; i < end; i++)
+		{
+			const unsigned int dimension = assembly->node_freedom[i];
+			if (dimension == 0) continue;
+			Coord sum;
+			for (uint j = assembly->node_stick_offset[i]; j < assembly->node_stick_offset[i + 1]; j++)
+			{
+				const uint stick = assembly->node_stick[j] / 2;
+				if (assembly->node_stick[j] % 2 == 0) sum = sum + (*force)[stick];
+				else sum = sum - (*force)[stick];
+			}
+			const uint index = assembly->node_index[i];
+			real projection[2];
+			if (dimension == 2) { projection[0] = sum.x; projection[1] = sum.y; }
+			else projection[0] = sum.dot(assembly->node_rail[i]);
+			for (uint k = 0; k < dimension; k++)
+			{
+				(*residual)(index + k) = (*load)(index + k) - projection[k];
+				real value = std::abs((*residual)(index + k));
+				if (!(value <= maximum)) maximum = (value == value) ? value : std::numeric_limits<real>::infinity(); //NaN never passes line search
+			}
+		}
+		chunk_maximum[t] = maximum;
+	};
+	if (pool != nullptr) pool->run(node_chunks, node_task);
+	else for (uint t = 0; t < node_chunks; t++) node_task(t);
+	real maximum = 0.0;
+	for (uint t = 0; t < node_chunks; t++) maximum = std::max(maximum, chunk_maximum[t]);
+	return maximum;
+}
+
+
+void p6::Construction::_apply_stiffness(
+	const Assembly *assembly,
+	ThreadPool *pool,
+	const std::vector<real> *stiffness,
+	const DenseVector *vector,
+	DenseVector *result) const noexcept
+{
+	//Stick adds K * (u0 - u1) to the first node and the opposite to the second, u being nodes' displacements
+	result->setZero(vector->size());
+	_for_each_stick(assembly, pool, [&](uint stick)
+	{
+		const real *s = stiffness->data() + 3 * stick;
+		Coord basis[2][2];
+		unsigned int dimension[2] = { _get_side_basis(assembly, 2 * stick, basis[0]), _get_side_basis(assembly, 2 * stick + 1, basis[1]) };
+		const uint index[2] = { assembly->index[2 * stick], assembly->index[2 * stick + 1] };
+		Coord relative;
+		for (uint k = 0; k < dimension[0]; k++) relative = relative + basis[0][k] * (*vector)(index[0] + k);
+		for (uint k = 0; k < dimension[1]; k++) relative = relative - basis[1][k] * (*vector)(index[1] + k);
+		Coord force(s[0] * relative.x + s[1] * relative.y, s[1] * relative.x + s[2] * relative.y);
+		for (uint k = 0; k < dimension[0]; k++) (*result)(index[0] + k) += force.dot(basis[0][k]);
+		for (uint k = 0; k < dimension[1]; k++) (*result)(index[1] + k) -= force.dot(basis[1][k]);
+	});
+}
+
+
+void p6::Construction::_get_stiffness_diagonal(
+	const Assembly *assembly,
+	ThreadPool *pool,
+	const std::vector<real> *stiffness,
+	DenseVector *diagonal) const noexcept
+{
+	diagonal->setZero();
+	_for_each_stick(assembly, pool, [&](uint stick)
+	{
+		const real *s = stiffness->data() + 3 * stick;
 		for (uint j = 0; j < 2; j++)
 		{
-			Coord stick_vector = delta * ((j == 0) ? 1.0 : -1.0) / length;
-			if (_node[node[j]].freedom == 1)
+			Coord basis[2];
+			unsigned int dimension = _get_side_basis(assembly, 2 * stick + j, basis);
+			for (uint l = 0; l < dimension; l++)
 			{
-				Coord rail_vector = _node[node[j]].vector / _node[node[j]].vector.norm();
-				(*residual)(map->at(node[j])) += tension * stick_vector.dot(rail_vector);
+				(*diagonal)(assembly->index[2 * stick + j] + l) += s[0] * sqr(basis[l].x) + 2.0 * s[1] * basis[l].x * basis[l].y + s[2] * sqr(basis[l].y);
 			}
-			else if (_node[node[j]].freedom == 2)
+		}
+	});
+}
+
+p6::LinearSolver *p6::Construction::_create_solver(const std::vector<uint> *map, unsigned int freedom) const
+{
+	p6::Preconditioner *preconditioner = nullptr;
+	if (_solver == Solver::cg || _solver == Solver::minres)
+	{
+		switch (_preconditioner)
+		{
+		case Preconditioner::jacobi: preconditioner = new JacobiPreconditioner; break;
+		case Preconditioner::incomplete_cholesky: preconditioner = new CholeskyPreconditioner; break;
+		default:
 			{
-				(*residual)(map->at(node[j])    ) += tension * stick_vector.x;
-				(*residual)(map->at(node[j]) + 1) += tension * stick_vector.y;
+				//Rigid body modes (two translations and rotation) as near null space, nodes as blocks
+				Coord center;
+				for (uint i = 0; i < _node.size(); i++) center = center + _node[i].coord / (real)_node.size();
+				DenseMatrix null_space(freedom, 3);
+				std::vector<uint> block(freedom);
+				for (uint i = 0; i < _node.size(); i++)
+				{
+					Coord basis[2];
+					unsigned int dimension = _get_basis(i, basis);
+					Coord arm = _node[i].coord - center;
+					for (uint k = 0; k < dimension; k++)
+					{
+						null_space(map->at(i) + k, 0) = basis[k].x;
+						null_space(map->at(i) + k, 1) = basis[k].y;
+						null_space(map->at(i) + k, 2) = basis[k].dot(Coord(-arm.y, arm.x));
+						block[map->at(i) + k] = i;
+					}
+				}
+				AMGPreconditioner *amg = new AMGPreconditioner;
+				amg->set_null_space(null_space, block);
+				preconditioner = amg;
 			}
+			break;
+		}
+	}
+
+	//Single precision factors are refined against double precision derivative, ill-conditioned derivatives fall back to double precision
+	if (_mixed_precision)
+	{
+		switch (_solver)
+		{
+		case Solver::lu: return new MixedLUSolver;
+		case Solver::ldlt: return new MixedLDLTSolver;
+		case Solver::llt: return new MixedLLTSolver;
+		default: break;
 		}
+	}
+
+	switch (_solver)
+	{
+	case Solver::ldlt: return new LDLTSolver;
+	case Solver::llt: return new LLTSolver;
+	case Solver::cg: return new IterativeSolver(IterativeSolver::Method::cg, preconditioner);
+	case Solver::minres: return new IterativeSolver(IterativeSolver::Method::minres, preconditioner);
+	default: return new LUSolver;
+	}
+}
+
+void p6::Construction::_fix_infinite_correction(
+	const DenseVector *state,
+	const Assembly *assembly,
+	DenseVector *correction) const noexcept
+{
+	P6_TRACE_SCOPE("fix_infinite_correction");
+	for (uint i = 0; i < assembly->area.size(); i++)
+	{
+		//Calculating essentials
+		real length = (_get_side_coord(assembly, 2 * i + 1, state) - _get_side_coord(assembly, 2 * i, state)).norm();
 
-		//Summing/setting derivative
-		if (derivative == nullptr) continue;
-		real dtension = _stick[i].area * material->derivative((length - initial_length) / initial_length);
-		if (dtension == 0.0) dtension = 1.0;
-		dtension *= _stick[i].area;
-		real dl_dx0 = -delta.x / length;
-		real dl_dy0 = -delta.y / length;
-		real dt_dx0 = dtension * dl_dx0 / initial_length;
-		real dt_dy0 = dtension * dl_dy0 / initial_length;
-		real dfx0_dx0 = (dt_dx0 * delta.x - tension - dl_dx0 * tension * delta.x) / sqr(length);
-		real dfx0_dy0 = delta.x * (dt_dy0 * length - dl_dy0 * tension) / sqr(length);
-		real dfy0_dx0 = delta.y * (dt_dx0 * length - dl_dx0 * tension) / sqr(length);
-		real dfy0_dy0 = (dt_dy0 * delta.y - tension - dl_dy0 * tension * delta.y) / sqr(length);
+		//Limiting corrections
+		const real limiter = _options.correction_limit * length;
 		for (uint j = 0; j < 2; j++)
 		{
-			if (_node[node[j]].freedom == 1) //Current point is fixed on rail
+			const uint index = assembly->index[2 * i + j];
+			for (uint k = 0; k < assembly->freedom[2 * i + j]; k++)
+			{
+				if ((*correction)(index + k) > limiter) (*correction)(index + k) = limiter;
+			}
+		}
+	}
+}
+
+p6::real p6::Construction::_get_tolerance(real smallest_force, const DenseVector *load) const noexcept
+{
+	const real absolute = (_options.absolute_tolerance > 0.0) ? _options.absolute_tolerance : 0.001 * smallest_force;
+	return std::max(absolute, _options.relative_tolerance * load->lpNorm<Eigen::Infinity>());
+}
+
+void p6::Construction::_solve_bfgs(
+	LinearSolver *solver,
+	const std::vector<DenseVector> *step,
+	const std::vector<DenseVector> *change,
+	const DenseVector *residual,
+	DenseVector *correction) const
+{
+	//Two-loop recursion, factorization is the initial inverse derivative
+	const uint updates = step->size();
+	std::vector<real> alpha(updates), rho(updates);
+	DenseVector right = *residual;
+	for (uint i = updates; i-- > 0; )
+	{
+		rho[i] = 1.0 / step->at(i).dot(change->at(i));
+		alpha[i] = rho[i] * step->at(i).dot(right);
+		right -= alpha[i] * change->at(i);
+	}
+	solver->solve(right, correction);
+	for (uint i = 0; i < updates; i++)
+	{
+		const real beta = rho[i] * change->at(i).dot(*correction);
+		*correction += (alpha[i] - beta) * step->at(i);
+	}
+}
+
+bool p6::Construction::_newton(
+	const DenseVector *load,
+	const Assembly *assembly,
+	ThreadPool *pool,
+	LinearSolver *solver,
+	SparseMatrix *derivative,
+	Factorization *factorization,
+	real tolerance,
+	DenseVector *state,
+	uint *iterations,
+	SimulationReport *report) const
+{
+	const uint freedom = state->size();
+	DenseVector correction(freedom), residual(freedom);
+	std::vector<real> stiffness;
+	DenseVector diagonal(freedom);
+	JacobiPreconditioner jacobi;
+	FunctionOperator stiffness_operator([&](const DenseVector &vector, DenseVector *result)
+	{
+		_apply_stiffness(assembly, pool, &stiffness, &vector, result);
+	});
+	const uint threads = (pool != nullptr) ? pool->thread_count() : 1;
+	std::vector<DenseVector> candidate_state(threads), candidate_residual(threads);
+	std::vector<std::vector<Coord>> candidate_force(threads);
+	std::vector<real> candidate_max_residual(threads);
+	real max_residual = _get_residual(state, load, assembly, pool, &candidate_force[0], &residual);
+	real residual_norm = residual.norm();
+	real forcing = 0.5;
+	unsigned int step_divider = 0;
+	bool finished = false, refactorize = false, rejected = false;
+	*iterations = 0;
+	MatrixOperator matrix_operator(derivative);
+	DenseVector gradient(freedom), product(freedom), step(freedom);
+	real radius = 0.0;
+	const std::function<void(uint, real)> accept = [&](uint t, real step_size)
+	{
+		//Candidate takes previous state and residual
+		factorization->current = false;
+		max_residual = candidate_max_residual[t];
+		state->swap(candidate_state[t]);
+		residual.swap(candidate_residual[t]);
+		if (step_size <= _options.step_tolerance * state->lpNorm<Eigen::Infinity>()) finished = true;
+
+		//Pair of step and residual change updates factorization if curvature is positive
+		if (_options.update == Update::bfgs && solver != nullptr)
+		{
+			if (factorization->step.size() == _options.max_updates) refactorize = true;
+			else
+			{
+				DenseVector step_vector = *state - candidate_state[t];
+				DenseVector change_vector = residual - candidate_residual[t];
+				if (step_vector.dot(change_vector) > 0.0)
+				{
+					factorization->step.push_back(step_vector);
+					factorization->change.push_back(change_vector);
+				}
+			}
+		}
+	};
+	std::chrono::steady_clock::time_point time;
+	const std::function<real()> lap = [&]() -> real
+	{
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		real seconds = std::chrono::duration<real>(now - time).count();
+		time = now;
+		return seconds;
+	};
+	while (!finished)
+	{
+		P6_TRACE_SCOPE("newton_iteration");
+		if (_async != nullptr && _async->_stopped()) return false;
+		if (_options.early_exit && max_residual < tolerance) break;
+		if (*iterations >= _options.max_iterations) break;
+		(*iterations)++;
+		rejected = false;
+		SimulationIteration iteration;
+		time = std::chrono::steady_clock::now();
+		const bool reuse = (solver != nullptr) && (_options.update != Update::newton) && factorization->valid && !refactorize;
+		if (solver != nullptr)
+		{
+			//Residual of current state is known from line search if factorization is reused
+			if (!reuse)
+			{
+				_fill_derivative_and_residual(state, load, assembly, pool, &residual, derivative, nullptr);
+				iteration.assembly_time = lap();
+				{ P6_TRACE_SCOPE("factorize"); if (!solver->factorize(*derivative)) return false; }
+				iteration.factorization_time = lap();
+				iteration.factorized = factorization->valid = factorization->current = true;
+				refactorize = false;
+				factorization->step.clear();
+				factorization->change.clear();
+			}
+			solver->set_tolerance(forcing);
+			{
+				P6_TRACE_SCOPE("solve");
+				if (factorization->step.empty()) solver->solve(residual, &correction);
+				else _solve_bfgs(solver, &factorization->step, &factorization->change, &residual, &correction);
+			}
+			iteration.solve_time = lap();
+			if (report != nullptr && !reuse)
+			{
+				report->nonzeros = derivative->nonZeros();
+				report->factor_nonzeros = solver->get_factor_nonzeros();
+				report->fill_in = (report->factor_nonzeros > report->nonzeros) ? (report->factor_nonzeros - report->nonzeros) : 0;
+			}
+		}
+		else
+		{
+			//Derivative is only stored as 2x2 blocks of sticks and applied stick by stick
+			_fill_derivative_and_residual(state, load, assembly, pool, &residual, nullptr, &stiffness);
+			_get_stiffness_diagonal(assembly, pool, &stiffness, &diagonal);
+			iteration.assembly_time = lap();
+			jacobi.factorize(diagonal);
+			iteration.factorization_time = lap();
+			iteration.factorized = true;
+			IterativeSolver::Method method = (_solver == Solver::minres) ? IterativeSolver::Method::minres : IterativeSolver::Method::cg;
+			{ P6_TRACE_SCOPE("solve"); IterativeSolver::solve(method, stiffness_operator, jacobi, residual, &correction, forcing, IterativeSolver::max_iterations); }
+			iteration.solve_time = lap();
+		}
+		if (_options.globalization == Globalization::line_search)
+		{
+			_fix_infinite_correction(state, assembly, &correction);
+			if (step_divider > 0) step_divider--;
+
+			//Line search: current step is evaluated by all threads together, if it fails,
+			//next halvings are evaluated concurrently, one per thread, and the longest acceptable one is taken.
+			//Step of reused factorization is not halved, derivative is refactorized instead
+			uint candidates = 1;
+			while (true)
 			{
-				Coord rail_vector = _node[node[j]].vector / _node[node[j]].vector.norm();
-				buffer->push_back(Eigen::Triplet<real>(map->at(node[j]), map->at(node[j]),
-				(
-					rail_vector.x * (rail_vector.x * dfx0_dx0 + rail_vector.y * dfx0_dy0) +
-					rail_vector.y * (rail_vector.x * dfy0_dx0 + rail_vector.y * dfy0_dy0)
-				)));
-				if (_node[node[j ^ 1]].freedom == 1) //Other point is fixed on rail
+				P6_TRACE_SCOPE("line_search");
+				std::function<void(uint)> task = [&](uint t)
+				{
+					if (step_divider + t > _options.max_halvings) { candidate_state[t] = *state; return; }
+					candidate_state[t] = *state - pow(0.5, step_divider + t) * correction;
+					if (candidate_state[t] == *state) return;
+					candidate_max_residual[t] = _get_residual(&candidate_state[t], load, assembly,
+						(candidates == 1) ? pool : nullptr, &candidate_force[t], &candidate_residual[t]);
+				};
+				if (candidates == 1) task(0);
+				else pool->run(candidates, task);
+				uint accepted = 0;
+				while (accepted < candidates)
 				{
-					Coord other_rail_vector = _node[node[j ^ 1]].vector / _node[node[j ^ 1]].vector.norm();
-					buffer->push_back(Eigen::Triplet<real>(map->at(node[j ^ 1]), map->at(node[j]),
-					-(
-						rail_vector.x * (other_rail_vector.x * dfx0_dx0 + other_rail_vector.y * dfx0_dy0) +
-						rail_vector.y * (other_rail_vector.x * dfy0_dx0 + other_rail_vector.y * dfy0_dy0)
-					)));
+					if (candidate_state[accepted] == *state) { finished = true; break; }
+					if (candidate_max_residual[accepted] < max_residual) break;
+					accepted++;
 				}
-				else if (_node[node[j ^ 1]].freedom == 2) //Other point is free
+				if (reuse && accepted == candidates) { refactorize = rejected = true; break; }
+				step_divider += accepted;
+				if (accepted < candidates)
 				{
-					buffer->push_back(Eigen::Triplet<real>(map->at(node[j ^ 1])    , map->at(node[j]), -(rail_vector.x * dfx0_dx0 + rail_vector.y * dfy0_dx0)));
-					buffer->push_back(Eigen::Triplet<real>(map->at(node[j ^ 1]) + 1, map->at(node[j]), -(rail_vector.x * dfx0_dy0 + rail_vector.y * dfy0_dy0)));
+					if (!finished)
+					{
+						accept(accepted, pow(0.5, step_divider) * correction.lpNorm<Eigen::Infinity>());
+						if (step_divider > 0) refactorize = true;
+					}
+					break;
 				}
+				candidates = threads;
 			}
-			else if (_node[node[j]].freedom == 2) //Current point is free
+		}
+		else
+		{
+			//Trust region: dogleg path from Cauchy point to Newton step is cut at radius, radius follows
+			//ratio of actual and predicted reductions of residual's squared norm, model of residual is R + K * step
+			P6_TRACE_SCOPE("trust_region");
+			const LinearOperator &derivative_operator = (solver != nullptr) ? static_cast<const LinearOperator &>(matrix_operator) : stiffness_operator;
+			derivative_operator.apply(residual, &gradient);
+			derivative_operator.apply(gradient, &product);
+			const real newton_norm = correction.norm(), gradient_norm = gradient.norm();
+			const real cauchy_factor = (gradient_norm > 0.0) ? sqr(gradient_norm) / product.squaredNorm() : 0.0;
+			if (radius == 0.0) radius = newton_norm;
+			uint trials = 0;
+			while (true)
 			{
-				buffer->push_back(Eigen::Triplet<real>(map->at(node[j])    , map->at(node[j])    , dfx0_dx0));
-				buffer->push_back(Eigen::Triplet<real>(map->at(node[j])    , map->at(node[j]) + 1, dfx0_dy0));
-				buffer->push_back(Eigen::Triplet<real>(map->at(node[j]) + 1, map->at(node[j])    , dfy0_dx0));
-				buffer->push_back(Eigen::Triplet<real>(map->at(node[j]) + 1, map->at(node[j]) + 1, dfy0_dy0));
-				if (_node[node[j ^ 1]].freedom == 1) //Other point is fixed on rail
+				if (newton_norm <= radius) step = -correction;
+				else if (cauchy_factor * gradient_norm >= radius) step = -(radius / gradient_norm) * gradient;
+				else
 				{
-					Coord other_rail_vector = _node[node[j ^ 1]].vector / _node[node[j ^ 1]].vector.norm();
-					buffer->push_back(Eigen::Triplet<real>(map->at(node[j])    , map->at(node[j ^ 1]), -(other_rail_vector.x * dfx0_dx0 + other_rail_vector.y * dfx0_dy0)));
-					buffer->push_back(Eigen::Triplet<real>(map->at(node[j]) + 1, map->at(node[j ^ 1]), -(other_rail_vector.x * dfy0_dx0 + other_rail_vector.y * dfy0_dy0)));
+					//Solving |cauchy + tau * (newton - cauchy)| = radius for tau in [0, 1]
+					DenseVector cauchy = -cauchy_factor * gradient;
+					DenseVector difference = -correction - cauchy;
+					const real a = difference.squaredNorm(), b = cauchy.dot(difference), c = cauchy.squaredNorm() - sqr(radius);
+					const real tau = (-b + sqrt(b * b - a * c)) / a;
+					step = cauchy + tau * difference;
 				}
-				else if (_node[node[j ^ 1]].freedom == 2) //Other point is free
+				candidate_state[0] = *state + step;
+				if (candidate_state[0] == *state || trials > _options.max_halvings) { finished = true; break; }
+				candidate_max_residual[0] = _get_residual(&candidate_state[0], load, assembly, pool, &candidate_force[0], &candidate_residual[0]);
+				derivative_operator.apply(step, &product);
+				const real predicted = -residual.dot(product) - 0.5 * product.squaredNorm();
+				const real actual = 0.5 * (residual.squaredNorm() - candidate_residual[0].squaredNorm());
+				const real ratio = (predicted > 0.0) ? (actual / predicted) : -1.0;
+				const real step_norm = step.norm();
+				if (ratio < 0.25) radius = 0.25 * step_norm;
+				else if (ratio > 0.75 && step_norm > 0.99 * radius) radius *= 2.0;
+				if (ratio > 1e-4)
 				{
-					buffer->push_back(Eigen::Triplet<real>(map->at(node[j])    , map->at(node[j ^ 1])    , -dfx0_dx0));
-					buffer->push_back(Eigen::Triplet<real>(map->at(node[j])    , map->at(node[j ^ 1]) + 1, -dfx0_dy0));
-					buffer->push_back(Eigen::Triplet<real>(map->at(node[j]) + 1, map->at(node[j ^ 1])    , -dfy0_dx0));
-					buffer->push_back(Eigen::Triplet<real>(map->at(node[j]) + 1, map->at(node[j ^ 1]) + 1, -dfy0_dy0));
+					accept(0, step.lpNorm<Eigen::Infinity>());
+					if (trials > 0) refactorize = true;
+					break;
 				}
+				if (reuse) { refactorize = rejected = true; break; }
+				trials++;
 			}
-		}	
+			iteration.radius = radius;
+		}
+
+		//Reporting iteration
+		if (report != nullptr)
+		{
+			iteration.increment = report->increment_load.size() - 1;
+			iteration.load = report->increment_load.back();
+			iteration.max_residual = max_residual;
+			iteration.step_divider = step_divider;
+			iteration.line_search_time = lap();
+			report->assembly_time += iteration.assembly_time;
+			report->factorization_time += iteration.factorization_time;
+			report->solve_time += iteration.solve_time;
+			report->line_search_time += iteration.line_search_time;
+			report->iteration.push_back(iteration);
+			if (_iteration_callback) _iteration_callback(iteration);
+			if (_async != nullptr) _async->_update(&iteration, report->iteration.size(), tolerance);
+		}
+
+		//Eisenstat-Walker forcing term (choice 2) for iterative solvers
+		if (finished) break;
+		if (rejected) continue;
+		real new_residual_norm = residual.norm();
+		if (new_residual_norm > _options.refactorization_ratio * residual_norm) refactorize = true;
+		real safeguard = 0.9 * sqr(forcing);
+		forcing = 0.9 * sqr(new_residual_norm / residual_norm);
+		if (safeguard > 0.1) forcing = std::max(forcing, safeguard);
+		forcing = std::min(forcing, 0.9);
+		residual_norm = new_residual_norm;
 	}
-	if (derivative != nullptr) derivative->setFromTriplets(buffer->begin(), buffer->end());
+	return max_residual < tolerance;
 }
 
-void p6::Construction::_fix_infinite_correction(
+bool p6::Construction::_continuation(
 	const std::vector<uint> *map,
-	const DenseVector *state,
-	DenseVector *correction) noexcept
+	const DenseVector *load,
+	const Assembly *assembly,
+	ThreadPool *pool,
+	LinearSolver *solver,
+	SparseMatrix *derivative,
+	Factorization *factorization,
+	real tolerance,
+	bool warm,
+	DenseVector *state,
+	const std::function<void(const DenseVector &, real)> &record,
+	SimulationReport *report) const
 {
-	for (uint i = 0; i < _stick.size(); i++)
+	//Unloaded construction is in equilibrium in initial coordinates
+	const uint freedom = state->size();
+	DenseVector converged(freedom), previous(freedom), increment_load(freedom);
+	_create_state(map, assembly, false, &converged);
+	if (record) record(converged, 0.0);
+
+	//Applying load in increments, next state is predicted by extrapolating two last converged ones.
+	//Full load applied at once may start from given state, increments are halved on failure
+	const real min_increment = 1.0 / (1024 * _load_steps);
+	real factor = 0.0, increment = 1.0 / _load_steps, previous_increment = 0.0;
+	while (factor < 1.0)
 	{
-		//Calculating essentials
-		const uint *node = _stick[i].node;
-		Coord coord[2];
-		for (uint j = 0; j < 2; j++)
+		real target = factor + increment;
+		if (target > 1.0 - 1e-9) target = 1.0;
+		increment_load = target * *load;
+		if (!warm)
 		{
-			if (_node[node[j]].freedom == 1) coord[j] = _node[node[j]].coord + _node[node[j]].vector * (*state)(map->at(node[j])) / _node[node[j]].vector.norm();
-			else if (_node[node[j]].freedom == 2) coord[j] = Coord((*state)(map->at(node[j])), (*state)(map->at(node[j]) + 1));
-			else coord[j] = _node[node[j]].coord;
+			*state = converged;
+			if (previous_increment > 0.0) *state += ((target - factor) / previous_increment) * (converged - previous);
+			factorization->current = false;
 		}
-		real length = (coord[1] - coord[0]).norm();
-
-		//Limiting corrections
-		const real limiter = 0.1 * length;
-		for (uint j = 0; j < 2; j++)
+		uint iterations;
+		if (report != nullptr)
 		{
-			if (_node[node[j]].freedom == 1)
-			{
-				if ((*correction)(map->at(node[j])) > limiter) (*correction)(map->at(node[j])) = limiter;
-			}
-			else if (_node[node[j]].freedom == 2)
+			report->increment_load.push_back(target);
+			report->increment_converged.push_back(0);
+		}
+		if (_newton(&increment_load, assembly, pool, solver, derivative, factorization, tolerance, state, &iterations, report))
+		{
+			if (report != nullptr) report->increment_converged.back() = 1;
+			previous.swap(converged);
+			converged = *state;
+			previous_increment = target - factor;
+			factor = target;
+			if (record) record(converged, factor);
+			if (iterations <= 5) increment *= 2.0;
+			else if (iterations > 10) increment /= 2.0;
+		}
+		else if (_async != nullptr && _async->_stopped()) return false;
+		else
+		{
+			//Factorization of diverged state is not reused
+			factorization->valid = false;
+			if (!warm)
 			{
-				if ((*correction)(map->at(node[j])    ) > limiter) (*correction)(map->at(node[j])    ) = limiter;
-				if ((*correction)(map->at(node[j]) + 1) > limiter) (*correction)(map->at(node[j]) + 1) = limiter;
+				increment /= 2.0;
+				if (increment < min_increment) return false;
 			}
 		}
+		warm = false;
 	}
+	*state = converged;
+	return true;
 }
 
 void p6::Construction::simulate(bool sim)
 {
+	P6_TRACE_SCOPE("simulate");
 	if (sim == _simulation) return;
-	else if (!sim) { _simulation = false; return; }
+	_last_solver.reset();
+	_last_derivative.reset();
+	if (!sim) { _simulation = false; return; }
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	_report = SimulationReport();
 
 	//Checking if materials are specified
 	_check_materials_specified();
 
 	//Find smallest force
-	real smallest_force = _find_smallest_force();
-	if (smallest_force == 0.0) { _copy_state(); _simulation = false; return; }
+	real smallest_force = _find_smallest_force(&_force);
+	if (smallest_force == 0.0) { _copy_state(); _simulation = false; _report.converged = true; return; }
 
 	//Creating node-to-free map
 	std::vector<uint> map;
 	unsigned int freedom = _create_map(&map);
 
 	//Declare variables
-	TripletVector buffer;
-	DenseVector state(freedom), forward_state(freedom), correction(freedom), residual(freedom);
-	SparseMatrix derivative(freedom, freedom);
-	Eigen::SparseLU<SparseMatrix, Eigen::COLAMDOrdering<int>> solver;
-	_create_state(&map, &state);
-	_fill_derivative_and_residual(&map, &state, &buffer, &residual, nullptr);
-	real max_residual = residual.array().abs().maxCoeff();
-	unsigned int step_divider = 0;
-	bool finished = false;
-	while (!finished)
+	Assembly assembly;
+	ThreadPool pool(_thread_count);
+	DenseVector state(freedom), load(freedom);
+	std::unique_ptr<SparseMatrix> derivative(new SparseMatrix(freedom, freedom));
+	std::unique_ptr<LinearSolver> solver;
+	if (!_matrix_free)
 	{
-		_fill_derivative_and_residual(&map, &state, &buffer, &residual, &derivative);
-		solver.analyzePattern(derivative);
-		solver.factorize(derivative);
-		correction = solver.solve(residual);
-		_fix_infinite_correction(&map, &state, &correction);
-		if (step_divider > 0) step_divider--;
-		while (true)
+		//Pattern does not change during simulation, it is analyzed once
+		_create_pattern(&map, derivative.get(), &assembly);
+		solver.reset(_create_solver(&map, freedom));
+		P6_TRACE_SCOPE("analyze");
+		solver->analyze(*derivative);
+	}
+	_create_colors(&assembly);
+	_create_adjacency(&assembly);
+	_create_model(&map, &assembly);
+	_create_load(&map, &_force, &load);
+	_report.tolerance = _get_tolerance(smallest_force, &load);
+
+	//Simulating, full load applied at once may start from last converged state
+	_path_load.clear();
+	for (uint i = 0; i < _node.size(); i++) _node[i].path.clear();
+	bool warm = (_load_steps == 1) && _create_state(&map, &assembly, _warm_start, &state);
+	Factorization factorization;
+	const bool converged = _continuation(&map, &load, &assembly, &pool, solver.get(), derivative.get(), &factorization, _report.tolerance, warm, &state,
+		[&](const DenseVector &recorded, real factor) { _record_path(&map, &recorded, factor); }, &_report);
+	_report.total_time = std::chrono::duration<real>(std::chrono::steady_clock::now() - start).count();
+	if (!converged) throw ConvergenceError();
+	_report.converged = true;
+	_apply_state(&map, &state);
+	_simulation = true;
+
+	//Keeping last factorization for sensitivity analysis if it belongs to converged state,
+	//early exit, modified Newton and BFGS may leave factorization of previous iterate
+	_last_map.swap(map);
+	if (solver != nullptr && factorization.valid && factorization.current)
+	{
+		_last_derivative = std::move(derivative);
+		_last_solver = std::move(solver);
+	}
+}
+
+std::unique_ptr<p6::AsyncSimulation> p6::Construction::simulate_async(real timeout)
+{
+	//Simulation checks for cancellation and deadline before every Newton iteration, cancelled simulation leaves construction not simulated
+	return std::unique_ptr<AsyncSimulation>(new AsyncSimulation(this, timeout));
+}
+
+void p6::Construction::simulate_load_cases(const std::vector<std::vector<Force>> &cases, LoadCaseResult *result) const
+{
+	//Checking if materials and forces are specified
+	_check_materials_specified();
+	for (uint i = 0; i < cases.size(); i++)
+	{
+		for (uint j = 0; j < cases[i].size(); j++)
+		{
+			if (cases[i][j].node >= _node.size()) throw std::runtime_error("Force is attached to non-existing node");
+		}
+	}
+
+	//Creating structures shared by all cases
+	std::vector<uint> map;
+	unsigned int freedom = _create_map(&map);
+	Assembly assembly;
+	ThreadPool pool(_thread_count);
+	SparseMatrix shared_derivative(freedom, freedom);
+	if (!_matrix_free) _create_pattern(&map, &shared_derivative, &assembly);
+	_create_colors(&assembly);
+	_create_adjacency(&assembly);
+	_create_model(&map, &assembly);
+
+	//Every worker owns solver (analyzed once for all it's cases) and derivative's values
+	const real nan = std::numeric_limits<real>::quiet_NaN();
+	result->converged.assign(cases.size(), 0);
+	result->displacement.assign(cases.size() * _node.size(), Coord(nan, nan));
+	result->force.assign(cases.size() * _stick.size(), nan);
+	const uint workers = std::min(pool.thread_count(), (uint)cases.size());
+	ThreadPool *case_pool = (workers < pool.thread_count()) ? &pool : nullptr;
+	std::atomic<uint> next(0);
+	std::vector<std::exception_ptr> error(pool.thread_count());
+	std::function<void(uint)> worker = [&](uint index)
+	{
+		try
+		{
+			std::unique_ptr<LinearSolver> solver;
+			SparseMatrix derivative(shared_derivative);
+			DenseVector load(freedom), state(freedom);
+			for (uint c = next++; c < cases.size(); c = next++)
+			{
+				real smallest_force = _find_smallest_force(&cases[c]);
+				if (smallest_force == 0.0) _create_state(&map, &assembly, false, &state);
+				else
+				{
+					if (!_matrix_free && solver == nullptr)
+					{
+						solver.reset(_create_solver(&map, freedom));
+						solver->analyze(derivative);
+					}
+					_create_load(&map, &cases[c], &load);
+					Factorization factorization;
+					if (!_continuation(&map, &load, &assembly, case_pool, solver.get(), &derivative, &factorization,
+						_get_tolerance(smallest_force, &load), false, &state, std::function<void(const DenseVector &, real)>(), nullptr)) continue;
+				}
+
+				//Writing results
+				result->converged[c] = 1;
+				for (uint i = 0; i < _node.size(); i++) result->displacement[c * _node.size() + i] = _get_coord(i, &map, &state) - _node[i].coord;
+				for (uint i = 0; i < _stick.size(); i++)
+				{
+					const uint *node = _stick[i].node;
+					real length = (_get_coord(node[1], &map, &state) - _get_coord(node[0], &map, &state)).norm();
+					real initial_length = (_node[node[0]].coord - _node[node[1]].coord).norm();
+					real stress, stress_derivative;
+					_material[_stick[i].material]->evaluate((length - initial_length) / initial_length, &stress, &stress_derivative);
+					result->force[c * _stick.size() + i] = _stick[i].area * stress;
+				}
+			}
+		}
+		catch (...)
+		{
+			//Pool does not forward exceptions, remaining cases are skipped and error is rethrown after workers join
+			error[index] = std::current_exception();
+			next = (uint)cases.size();
+		}
+	};
+	if (case_pool != nullptr) worker(0);
+	else pool.run(workers, worker);
+	for (uint i = 0; i < error.size(); i++) if (error[i] != nullptr) std::rethrow_exception(error[i]);
+
+	//Envelopes among converged cases
+	const real infinity = std::numeric_limits<real>::infinity();
+	result->min_displacement.assign(_node.size(), Coord(infinity, infinity));
+	result->max_displacement.assign(_node.size(), Coord(-infinity, -infinity));
+	result->min_force.assign(_stick.size(), infinity);
+	result->max_force.assign(_stick.size(), -infinity);
+	for (uint c = 0; c < cases.size(); c++)
+	{
+		if (!result->converged[c]) continue;
+		for (uint i = 0; i < _node.size(); i++)
+		{
+			const Coord displacement = result->displacement[c * _node.size() + i];
+			result->min_displacement[i] = Coord(std::min(result->min_displacement[i].x, displacement.x), std::min(result->min_displacement[i].y, displacement.y));
+			result->max_displacement[i] = Coord(std::max(result->max_displacement[i].x, displacement.x), std::max(result->max_displacement[i].y, displacement.y));
+		}
+		for (uint i = 0; i < _stick.size(); i++)
+		{
+			result->min_force[i] = std::min(result->min_force[i], result->force[c * _stick.size() + i]);
+			result->max_force[i] = std::max(result->max_force[i], result->force[c * _stick.size() + i]);
+		}
+	}
+}
+
+void p6::Construction::get_sensitivity(Response response, uint index, Coord direction, std::vector<real> *area, std::vector<Coord> *coord)
+{
+	assert(_simulation);
+	assert(response == Response::compliance || (response == Response::node_displacement && index < _node.size()) || index < _stick.size());
+
+	//Restoring final state
+	const std::vector<uint> *map = &_last_map;
+	uint freedom = 0;
+	for (uint i = 0; i < _node.size(); i++) freedom += _node[i].freedom;
+	DenseVector state(freedom);
+	for (uint i = 0; i < _node.size(); i++)
+	{
+		if (_node[i].freedom == 1)
+		{
+			state(map->at(i)) = (_node[i].coord_simulated - _node[i].coord).dot(_node[i].vector) / _node[i].vector.norm();
+		}
+		else if (_node[i].freedom == 2)
 		{
-			forward_state = state - pow(0.5, step_divider) * correction;
-			if (forward_state == state) { finished = true; break; }
-			_fill_derivative_and_residual(&map, &forward_state, &buffer, &residual, nullptr);
-			real new_residual = residual.array().abs().maxCoeff();
-			if (new_residual < max_residual) { max_residual = new_residual; state = forward_state; break; }
-			else step_divider++;
+			state(map->at(i)    ) = _node[i].coord_simulated.x;
+			state(map->at(i) + 1) = _node[i].coord_simulated.y;
 		}
 	}
-	if (max_residual < 0.001 * smallest_force)
+
+	//Matrix-free simulation or early exit keeps no factorization, derivative is created and factorized once at final state
+	if (_last_solver == nullptr)
+	{
+		Assembly assembly;
+		DenseVector residual(freedom), load = DenseVector::Zero(freedom);
+		std::unique_ptr<SparseMatrix> derivative(new SparseMatrix(freedom, freedom));
+		std::unique_ptr<LinearSolver> solver(_create_solver(map, freedom));
+		_create_pattern(map, derivative.get(), &assembly);
+		_create_colors(&assembly);
+		_create_model(map, &assembly);
+		_fill_derivative_and_residual(&state, &load, &assembly, nullptr, &residual, derivative.get(), nullptr);
+		solver->analyze(*derivative);
+		if (!solver->factorize(*derivative)) throw std::runtime_error("Derivative is singular");
+		_last_derivative = std::move(derivative);
+		_last_solver = std::move(solver);
+	}
+
+	//Direct derivatives of response: by state into adjoint's right side, by areas and coordinates into output
+	area->assign(_stick.size(), 0.0);
+	coord->assign(_node.size(), Coord());
+	DenseVector right = DenseVector::Zero(freedom), adjoint(freedom);
+	if (response == Response::stick_force)
 	{
-		_apply_state(&map, &state);
-		_simulation = true;
+		//Force is a * s(L / L0 - 1), it depends on state and coordinates of fixed and rail nodes through L, on coordinates through L0
+		const uint *node = _stick[index].node;
+		Coord delta = _node[node[1]].coord_simulated - _node[node[0]].coord_simulated;
+		Coord initial_delta = _node[node[1]].coord - _node[node[0]].coord;
+		real length = delta.norm(), initial_length = initial_delta.norm();
+		real stress, stress_derivative;
+		_material[_stick[index].material]->evaluate(length / initial_length - 1.0, &stress, &stress_derivative);
+		Coord stick_vector = delta / length, initial_vector = initial_delta / initial_length;
+		real dforce = _stick[index].area * stress_derivative / initial_length;
+		real dforce_dinitial = -dforce * length / initial_length;
+		(*area)[index] += stress;
+		for (uint j = 0; j < 2; j++)
+		{
+			const real sign = (j == 0) ? -1.0 : 1.0;
+			Coord gradient = stick_vector * (sign * dforce);
+			Coord basis[2];
+			unsigned int dimension = _get_basis(node[j], basis);
+			for (uint k = 0; k < dimension; k++) right(map->at(node[j]) + k) += gradient.dot(basis[k]);
+			if (_node[node[j]].freedom != 2) (*coord)[node[j]] = (*coord)[node[j]] + gradient;
+			(*coord)[node[j]] = (*coord)[node[j]] + initial_vector * (sign * dforce_dinitial);
+		}
 	}
 	else
 	{
-		throw std::runtime_error("Simulation does not converge");
+		//Compliance and displacement are sums of f * (x - X), x does not depend on X for free nodes only
+		std::vector<Force> weight;
+		if (response == Response::compliance) weight = _force;
+		else { Force f; f.node = index; f.direction = direction; weight.push_back(f); }
+		for (uint i = 0; i < weight.size(); i++)
+		{
+			const uint node = weight[i].node;
+			Coord basis[2];
+			unsigned int dimension = _get_basis(node, basis);
+			for (uint k = 0; k < dimension; k++) right(map->at(node) + k) += weight[i].direction.dot(basis[k]);
+			if (_node[node].freedom == 2) (*coord)[node] = (*coord)[node] - weight[i].direction;
+		}
+	}
+
+	//Adjoint system K * l = dJ/du, derivative is symmetric, total derivative is dJ/dp - l^T * dR/dp
+	_last_solver->set_tolerance(1e-12);
+	_last_solver->solve(right, &adjoint);
+	for (uint i = 0; i < _stick.size(); i++)
+	{
+		//Adjoint displacements of stick's nodes
+		const uint *node = _stick[i].node;
+		Coord adjoint_coord[2];
+		for (uint j = 0; j < 2; j++)
+		{
+			Coord basis[2];
+			unsigned int dimension = _get_basis(node[j], basis);
+			for (uint k = 0; k < dimension; k++) adjoint_coord[j] = adjoint_coord[j] + basis[k] * adjoint(map->at(node[j]) + k);
+		}
+		Coord adjoint_delta = adjoint_coord[1] - adjoint_coord[0];
+		if (adjoint_delta.x == 0.0 && adjoint_delta.y == 0.0) continue;
+
+		//Residual of first node is -T * e, of second node is T * e
+		Coord delta = _node[node[1]].coord_simulated - _node[node[0]].coord_simulated;
+		Coord initial_delta = _node[node[1]].coord - _node[node[0]].coord;
+		real length = delta.norm(), initial_length = initial_delta.norm();
+		real stress, stress_derivative;
+		_material[_stick[i].material]->evaluate(length / initial_length - 1.0, &stress, &stress_derivative);
+		Coord stick_vector = delta / length, initial_vector = initial_delta / initial_length;
+		real tension = _stick[i].area * stress;
+		real dtension = _stick[i].area * stress_derivative / initial_length;
+		real dtension_dinitial = -dtension * length / initial_length;
+		real projection = adjoint_delta.dot(stick_vector);
+		(*area)[i] -= stress * projection;
+
+		//Fixed and rail nodes move with their coordinates, K * D = T' * e * (e . D) + T / L * (D - e * (e . D))
+		Coord stiffness_delta = stick_vector * (dtension * projection) + (adjoint_delta - stick_vector * projection) * (tension / length);
+		for (uint j = 0; j < 2; j++)
+		{
+			const real sign = (j == 0) ? -1.0 : 1.0;
+			if (_node[node[j]].freedom != 2) (*coord)[node[j]] = (*coord)[node[j]] - stiffness_delta * sign;
+			(*coord)[node[j]] = (*coord)[node[j]] - initial_vector * (sign * dtension_dinitial * projection);
+		}
+	}
+}
+
+bool p6::Construction::get_simulation() const noexcept
+{
+	return _simulation;
+}
+
+void p6::Construction::set_thread_count(uint count) noexcept
+{
+	_thread_count = count;
+}
+
+p6::uint p6::Construction::get_thread_count() const noexcept
+{
+	return _thread_count;
+}
+
+void p6::Construction::set_solver(Solver solver) noexcept
+{
+	_solver = solver;
+}
+
+p6::Construction::Solver p6::Construction::get_solver() const noexcept
+{
+	return _solver;
+}
+
+void p6::Construction::set_preconditioner(Preconditioner preconditioner) noexcept
+{
+	_preconditioner = preconditioner;
+}
+
+p6::Construction::Preconditioner p6::Construction::get_preconditioner() const noexcept
+{
+	return _preconditioner;
+}
+
+void p6::Construction::set_matrix_free(bool matrix_free) noexcept
+{
+	_matrix_free = matrix_free;
+}
+
+bool p6::Construction::get_matrix_free() const noexcept
+{
+	return _matrix_free;
+}
+
+void p6::Construction::set_warm_start(bool warm_start) noexcept
+{
+	_warm_start = warm_start;
+}
+
+bool p6::Construction::get_warm_start() const noexcept
+{
+	return _warm_start;
+}
+
+void p6::Construction::set_load_steps(uint steps) noexcept
+{
+	assert(steps > 0);
+	_load_steps = steps;
+}
+
+p6::uint p6::Construction::get_load_steps() const noexcept
+{
+	return _load_steps;
+}
+
+void p6::Construction::set_renumbering(bool renumbering) noexcept
+{
+	_renumbering = renumbering;
+}
+
+bool p6::Construction::get_renumbering() const noexcept
+{
+	return _renumbering;
+}
+
+void p6::Construction::set_mixed_precision(bool mixed_precision) noexcept
+{
+	_mixed_precision = mixed_precision;
+}
+
+bool p6::Construction::get_mixed_precision() const noexcept
+{
+	return _mixed_precision;
+}
+
+void p6::Construction::set_solver_options(const SolverOptions &options) noexcept
+{
+	assert(options.absolute_tolerance >= 0.0 && options.relative_tolerance >= 0.0 && options.step_tolerance >= 0.0);
+	assert(options.max_iterations > 0 && options.correction_limit > 0.0 && options.refactorization_ratio > 0.0);
+	_options = options;
+}
+
+const p6::Construction::SolverOptions &p6::Construction::get_solver_options() const noexcept
+{
+	return _options;
+}
+
+void p6::Construction::set_iteration_callback(const std::function<void(const SimulationIteration &)> &callback) noexcept
+{
+	_iteration_callback = callback;
+}
+
+const p6::Construction::SimulationReport &p6::Construction::get_report() const noexcept
+{
+	return _report;
+}
+
+p6::uint p6::Construction::get_path_size() const noexcept
+{
+	return _path_load.size();
+}
+
+p6::real p6::Construction::get_path_load(uint point) const noexcept
+{
+	return _path_load[point];
+}
+
+p6::ConvergenceError::ConvergenceError() : std::runtime_error("Simulation does not converge")
+{
+}
+
+p6::Construction::Construction() noexcept
+{
+}
+
+p6::Construction::Construction(const Construction &construction)
+{
+	*this = construction;
+}
+
+p6::Construction &p6::Construction::operator=(const Construction &construction)
+{
+	if (this == &construction) return *this;
+	for (uint i = 0; i < _material.size(); i++) delete _material[i];
+	_material.clear();
+	for (uint i = 0; i < construction._material.size(); i++)
+	{
+		const Material *material = construction._material[i];
+		if (material->type() == Material::Type::linear) _material.push_back(new LinearMaterial(material->name(), ((const LinearMaterial*)material)->modulus()));
+		else _material.push_back(new NonlinearMaterial(material->name(), ((const NonlinearMaterial*)material)->formula()));
 	}
+	_node = construction._node;
+	_stick = construction._stick;
+	_force = construction._force;
+	_simulation = construction._simulation;
+	_thread_count = construction._thread_count;
+	_solver = construction._solver;
+	_preconditioner = construction._preconditioner;
+	_matrix_free = construction._matrix_free;
+	_warm_start = construction._warm_start;
+	_load_steps = construction._load_steps;
+	_renumbering = construction._renumbering;
+	_mixed_precision = construction._mixed_precision;
+	_options = construction._options;
+	_report = construction._report;
+	_path_load = construction._path_load;
+	_last_map = construction._last_map;
+	_last_derivative.reset();
+	_last_solver.reset();
+	return *this;
 }
 
 p6::Construction::~Construction()
@@ -0,0 +1,140 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#include "../header/p6_iterative_solver.hpp"
+#include <cmath>
+#include <limits>
+
+p6::LinearOperator::~LinearOperator() noexcept
+{}
+
+p6::MatrixOperator::MatrixOperator(const SparseMatrix *matrix) noexcept : _matrix(matrix)
+{}
+
+void p6::MatrixOperator::apply(const DenseVector &vector, DenseVector *result) const
+{
+	*result = *_matrix * vector;
+}
+
+p6::FunctionOperator::FunctionOperator(const std::function<void(const DenseVector &, DenseVector *)> &function) : _function(function)
+{}
+
+void p6::FunctionOperator::apply(const DenseVector &vector, DenseVector *result) const
+{
+	_function(vector, result);
+}
+
+p6::IterativeSolver::IterativeSolver(Method method, Preconditioner *preconditioner) noexcept
+	: _method(method), _preconditioner(preconditioner)
+{}
+
+void p6::IterativeSolver::analyze(const SparseMatrix &matrix)
+{
+	_preconditioner->analyze(matrix);
+}
+
+bool p6::IterativeSolver::factorize(const SparseMatrix &matrix)
+{
+	_matrix = &matrix;
+	_preconditioner->factorize(matrix);
+	return true;
+}
+
+void p6::IterativeSolver::solve(const DenseVector &right, DenseVector *solution)
+{
+	solve(_method, MatrixOperator(_matrix), *_preconditioner, right, solution, _tolerance, max_iterations);
+}
+
+void p6::IterativeSolver::set_tolerance(real tolerance) noexcept
+{
+	_tolerance = tolerance;
+}
+
+p6::uint p6::IterativeSolver::solve(Method method, const LinearOperator &matrix, const Preconditioner &preconditioner,
+	const DenseVector &right, DenseVector *solution, real tolerance, uint max_iterations)
+{
+	if (method == Method::cg) return conjugate_gradient(matrix, preconditioner, right, solution, tolerance, max_iterations);
+	else return minimal_residual(matrix, preconditioner, right, solution, tolerance, max_iterations);
+}
+
+p6::uint p6::IterativeSolver::conjugate_gradient(const LinearOperator &matrix, const Preconditioner &preconditioner,
+	const DenseVector &right, DenseVector *solution, real tolerance, uint max_iterations)
+{
+	solution->setZero(right.size());
+	const real threshold = sqr(tolerance) * right.squaredNorm();
+	if (right.squaredNorm() == 0.0) return 0;
+	DenseVector residual = right, preconditioned, direction, product;
+	preconditioner.apply(residual, &preconditioned);
+	direction = preconditioned;
+	real alignment = residual.dot(preconditioned);
+	for (uint i = 0; i < max_iterations; i++)
+	{
+		matrix.apply(direction, &product);
+		const real curvature = direction.dot(product);
+		if (!(curvature > 0.0)) return i; //Matrix is not positive definite
+		const real step = alignment / curvature;
+		*solution += step * direction;
+		residual -= step * product;
+		if (residual.squaredNorm() <= threshold) return i + 1;
+		preconditioner.apply(residual, &preconditioned);
+		const real new_alignment = residual.dot(preconditioned);
+		direction = preconditioned + (new_alignment / alignment) * direction;
+		alignment = new_alignment;
+	}
+	return max_iterations;
+}
+
+p6::uint p6::IterativeSolver::minimal_residual(const LinearOperator &matrix, const Preconditioner &preconditioner,
+	const DenseVector &right, DenseVector *solution, real tolerance, uint max_iterations)
+{
+	//Preconditioned MINRES of Paige and Saunders, tolerance is applied to preconditioned residual norm
+	solution->setZero(right.size());
+	DenseVector r1 = right, r2 = right, y, v, w = DenseVector::Zero(right.size()), w1, w2 = w;
+	preconditioner.apply(r1, &y);
+	const real beta1 = std::sqrt(std::max(r1.dot(y), 0.0));
+	if (beta1 == 0.0) return 0;
+	real beta = beta1, old_beta = 0.0, dbar = 0.0, epsilon = 0.0, phibar = beta1, cs = -1.0, sn = 0.0;
+	for (uint i = 0; i < max_iterations; i++)
+	{
+		//Lanczos step
+		v = y / beta;
+		matrix.apply(v, &y);
+		if (i > 0) y -= (beta / old_beta) * r1;
+		const real alpha = v.dot(y);
+		y -= (alpha / beta) * r2;
+		r1 = r2;
+		r2 = y;
+		preconditioner.apply(r2, &y);
+		old_beta = beta;
+		const real beta_square = r2.dot(y);
+		if (beta_square < 0.0) return i; //Preconditioner is not positive definite
+		beta = std::sqrt(beta_square);
+
+		//Givens rotation
+		const real old_epsilon = epsilon;
+		const real delta = cs * dbar + sn * alpha;
+		const real gbar = sn * dbar - cs * alpha;
+		epsilon = sn * beta;
+		dbar = -cs * beta;
+		const real gamma = std::max(std::hypot(gbar, beta), std::numeric_limits<real>::min());
+		cs = gbar / gamma;
+		sn = beta / gamma;
+		const real phi = cs * phibar;
+		phibar = sn * phibar;
+
+		//Updating solution
+		w1 = w2;
+		w2 = w;
+		w = (v - old_epsilon * w1 - delta * w2) / gamma;
+		*solution += phi * w;
+		if (phibar <= tolerance * beta1 || beta == 0.0) return i + 1;
+	}
+	return max_iterations;
+}
@@ -44,3 +44,9 @@ p6::real p6::LinearMaterial::derivative(real strain) const noexcept
 {
 	return _modulus;
 }
+
+void p6::LinearMaterial::evaluate(real strain, real *stress, real *derivative) const noexcept
+{
+	*stress = _modulus * strain;
+	*derivative = _modulus;
+}
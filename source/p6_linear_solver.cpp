@@ -0,0 +1,190 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#include "../header/p6_linear_solver.hpp"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+void p6::LinearSolver::set_tolerance(real) noexcept
+{}
+
+p6::uint p6::LinearSolver::get_factor_nonzeros() const noexcept
+{
+	return 0;
+}
+
+p6::LinearSolver::~LinearSolver() noexcept
+{}
+
+void p6::LUSolver::analyze(const SparseMatrix &matrix)
+{
+	_solver.analyzePattern(matrix);
+}
+
+bool p6::LUSolver::factorize(const SparseMatrix &matrix)
+{
+	_solver.factorize(matrix);
+	return _solver.info() == Eigen::Success;
+}
+
+void p6::LUSolver::solve(const DenseVector &right, DenseVector *solution)
+{
+	*solution = _solver.solve(right);
+}
+
+p6::uint p6::LUSolver::get_factor_nonzeros() const noexcept
+{
+	return _solver.nnzL() + _solver.nnzU();
+}
+
+template<> bool p6::LDLTSolver::_positive_definite() const noexcept
+{
+	//LDLT factorizes indefinite matrices too, positive definite matrix has positive pivots
+	return _solver.info() == Eigen::Success && _solver.vectorD().minCoeff() > 0.0;
+}
+
+template<> bool p6::LLTSolver::_positive_definite() const noexcept
+{
+	return _solver.info() == Eigen::Success;
+}
+
+template<> p6::uint p6::LDLTSolver::get_factor_nonzeros() const noexcept
+{
+	//L is stored without unit diagonal, D separately
+	if (_fallback_used) return _fallback.get_factor_nonzeros();
+	return 2 * _solver.matrixL().nestedExpression().nonZeros() + _solver.rows();
+}
+
+template<> p6::uint p6::LLTSolver::get_factor_nonzeros() const noexcept
+{
+	if (_fallback_used) return _fallback.get_factor_nonzeros();
+	return 2 * _solver.matrixL().nestedExpression().nonZeros() - _solver.rows();
+}
+
+template<class Solver> void p6::CholeskySolver<Solver>::analyze(const SparseMatrix &matrix)
+{
+	_solver.analyzePattern(matrix);
+	_fallback_analyzed = false;
+}
+
+template<class Solver> bool p6::CholeskySolver<Solver>::factorize(const SparseMatrix &matrix)
+{
+	//Positive definite matrix has positive pivots, otherwise the construction is near buckling
+	_solver.factorize(matrix);
+	_fallback_used = !_positive_definite();
+	if (!_fallback_used) return true;
+	if (!_fallback_analyzed) { _fallback.analyze(matrix); _fallback_analyzed = true; }
+	return _fallback.factorize(matrix);
+}
+
+template<class Solver> void p6::CholeskySolver<Solver>::solve(const DenseVector &right, DenseVector *solution)
+{
+	if (_fallback_used) _fallback.solve(right, solution);
+	else *solution = _solver.solve(right);
+}
+
+template class p6::CholeskySolver<Eigen::SimplicialLDLT<p6::SparseMatrix, Eigen::Lower, Eigen::AMDOrdering<int>>>;
+template class p6::CholeskySolver<Eigen::SimplicialLLT<p6::SparseMatrix, Eigen::Lower, Eigen::AMDOrdering<int>>>;
+
+template<> bool p6::MixedLDLTSolver::_factorized() const noexcept
+{
+	return _solver.info() == Eigen::Success && _solver.vectorD().minCoeff() > 0.0f;
+}
+
+template<> p6::uint p6::MixedLUSolver::get_factor_nonzeros() const noexcept
+{
+	if (_fallback_used) return _fallback.get_factor_nonzeros();
+	return _solver.nnzL() + _solver.nnzU();
+}
+
+template<> p6::uint p6::MixedLDLTSolver::get_factor_nonzeros() const noexcept
+{
+	if (_fallback_used) return _fallback.get_factor_nonzeros();
+	return 2 * _solver.matrixL().nestedExpression().nonZeros() + _solver.rows();
+}
+
+template<> p6::uint p6::MixedLLTSolver::get_factor_nonzeros() const noexcept
+{
+	if (_fallback_used) return _fallback.get_factor_nonzeros();
+	return 2 * _solver.matrixL().nestedExpression().nonZeros() - _solver.rows();
+}
+
+template<class Solver, class Fallback> bool p6::MixedPrecisionSolver<Solver, Fallback>::_factorized() const noexcept
+{
+	return _solver.info() == Eigen::Success;
+}
+
+template<class Solver, class Fallback> bool p6::MixedPrecisionSolver<Solver, Fallback>::_factorize_fallback()
+{
+	if (!_fallback_analyzed) { _fallback.analyze(*_double_matrix); _fallback_analyzed = true; }
+	_fallback_used = true;
+	return _fallback.factorize(*_double_matrix);
+}
+
+template<class Solver, class Fallback> void p6::MixedPrecisionSolver<Solver, Fallback>::analyze(const SparseMatrix &matrix)
+{
+	_matrix = matrix.cast<float>();
+	_matrix.makeCompressed();
+	_solver.analyzePattern(_matrix);
+	_fallback_analyzed = false;
+	_fallback_used = false;
+	_stalled = false;
+}
+
+template<class Solver, class Fallback> bool p6::MixedPrecisionSolver<Solver, Fallback>::factorize(const SparseMatrix &matrix)
+{
+	//Pattern is the analyzed one, only values are converted
+	_double_matrix = &matrix;
+	_fallback_used = false;
+	if (_stalled) return _factorize_fallback();
+	std::transform(matrix.valuePtr(), matrix.valuePtr() + matrix.nonZeros(), _matrix.valuePtr(), [](real value) { return (float)value; });
+	_solver.factorize(_matrix);
+	if (_factorized()) return true;
+	return _factorize_fallback();
+}
+
+template<class Solver, class Fallback> void p6::MixedPrecisionSolver<Solver, Fallback>::solve(const DenseVector &right, DenseVector *solution)
+{
+	if (_fallback_used) { _fallback.solve(right, solution); return; }
+
+	//Residual is calculated in double precision, correction is found with single precision factors.
+	//Residual is normalized before conversion, so it does not underflow as it decreases
+	solution->setZero(right.size());
+	DenseVector residual = right;
+	const real target = _tolerance * right.norm();
+	real residual_norm = right.norm();
+	real previous_norm = std::numeric_limits<real>::infinity();
+	for (uint i = 0; i < max_refinements; i++)
+	{
+		if (residual_norm <= target) return;
+		if (!(residual_norm < 0.5 * previous_norm)) break; //Refinement stalled or diverged
+		const FloatVector correction = _solver.solve((residual / residual_norm).cast<float>());
+		*solution += correction.cast<real>() * residual_norm;
+		residual = right - (*_double_matrix) * (*solution);
+		previous_norm = residual_norm;
+		residual_norm = residual.norm();
+	}
+	if (residual_norm <= target) return;
+
+	//Matrix is too ill-conditioned for single precision, it and following matrices with this pattern are factorized in double precision
+	_stalled = true;
+	if (!_factorize_fallback()) throw std::runtime_error("Double precision factorization failed");
+	_fallback.solve(right, solution);
+}
+
+template<class Solver, class Fallback> bool p6::MixedPrecisionSolver<Solver, Fallback>::get_fallback_used() const noexcept
+{
+	return _fallback_used;
+}
+
+template class p6::MixedPrecisionSolver<Eigen::SparseLU<Eigen::SparseMatrix<float>, Eigen::COLAMDOrdering<int>>, p6::LUSolver>;
+template class p6::MixedPrecisionSolver<Eigen::SimplicialLDLT<Eigen::SparseMatrix<float>, Eigen::Lower, Eigen::AMDOrdering<int>>, p6::LDLTSolver>;
+template class p6::MixedPrecisionSolver<Eigen::SimplicialLLT<Eigen::SparseMatrix<float>, Eigen::Lower, Eigen::AMDOrdering<int>>, p6::LLTSolver>;
@@ -0,0 +1,345 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#include "../header/p6_monte_carlo.hpp"
+#include "../header/p6_thread_pool.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <exception>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+p6::MonteCarlo::MonteCarlo(const Construction *construction) noexcept : _construction(construction)
+{
+	const real infinity = std::numeric_limits<real>::infinity();
+	_area_deviation.resize(construction->get_stick_count(), 0.0);
+	_modulus_deviation.resize(construction->get_material_count(), 0.0);
+	_force_deviation.resize(construction->get_force_count(), 0.0);
+	_force_limit.resize(construction->get_stick_count(), infinity);
+	_displacement_limit.resize(construction->get_node_count(), infinity);
+}
+
+void p6::MonteCarlo::set_seed(uint seed) noexcept
+{
+	_seed = seed;
+}
+
+void p6::MonteCarlo::set_sample_count(uint count) noexcept
+{
+	_sample_count = count;
+}
+
+void p6::MonteCarlo::set_stick_area_deviation(uint stick, real deviation) noexcept
+{
+	assert(deviation >= 0.0);
+	_area_deviation[stick] = deviation;
+}
+
+void p6::MonteCarlo::set_material_modulus_deviation(uint material, real deviation) noexcept
+{
+	assert(deviation >= 0.0);
+	_modulus_deviation[material] = deviation;
+}
+
+void p6::MonteCarlo::set_force_deviation(uint force, real deviation) noexcept
+{
+	assert(deviation >= 0.0);
+	_force_deviation[force] = deviation;
+}
+
+void p6::MonteCarlo::set_stick_force_limit(uint stick, real limit) noexcept
+{
+	_force_limit[stick] = limit;
+}
+
+void p6::MonteCarlo::set_node_displacement_limit(uint node, real limit) noexcept
+{
+	_displacement_limit[node] = limit;
+}
+
+p6::uint p6::MonteCarlo::add_quantile(real probability) noexcept
+{
+	assert(probability >= 0.0 && probability <= 1.0);
+	_probability.push_back(probability);
+	return _probability.size() - 1;
+}
+
+p6::real p6::MonteCarlo::_uniform(uint seed, uint sample, uint variable) noexcept
+{
+	//Counter-based generator: SplitMix64 finalizer applied to seed, sample and variable in turn
+	unsigned long long counter[3] = { seed, sample, variable };
+	unsigned long long hash = 0;
+	for (uint i = 0; i < 3; i++)
+	{
+		hash = (hash ^ counter[i]) + 0x9E3779B97F4A7C15ULL;
+		hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+		hash = hash ^ (hash >> 31);
+	}
+	return ((real)(hash >> 11) + 0.5) / 9007199254740992.0;
+}
+
+p6::real p6::MonteCarlo::_lognormal(uint seed, uint sample, uint variable, real deviation) noexcept
+{
+	//Box-Muller transform, every variable uses two counters
+	if (deviation == 0.0) return 1.0;
+	real normal = std::sqrt(-2.0 * std::log(_uniform(seed, sample, 2 * variable))) * std::cos(2.0 * pi() * _uniform(seed, sample, 2 * variable + 1));
+	real sigma2 = std::log(1.0 + sqr(deviation));
+	return std::exp(std::sqrt(sigma2) * normal - 0.5 * sigma2);
+}
+
+void p6::MonteCarlo::_add_quantile(Quantile *quantile, real probability, uint count, real value) noexcept
+{
+	//First five values are stored as they are
+	if (count < 5)
+	{
+		quantile->height[count] = value;
+		if (count < 4) return;
+		std::sort(quantile->height, quantile->height + 5);
+		for (uint i = 0; i < 5; i++) quantile->position[i] = (real)(i + 1);
+		quantile->desired[0] = 1.0;
+		quantile->desired[1] = 1.0 + 2.0 * probability;
+		quantile->desired[2] = 1.0 + 4.0 * probability;
+		quantile->desired[3] = 3.0 + 2.0 * probability;
+		quantile->desired[4] = 5.0;
+		return;
+	}
+
+	//Finding cell of value and moving markers above it
+	real *q = quantile->height;
+	real *n = quantile->position;
+	uint k;
+	if (value < q[0]) { q[0] = value; k = 0; }
+	else if (value >= q[4]) { q[4] = value; k = 3; }
+	else { k = 0; while (value >= q[k + 1]) k++; }
+	for (uint i = k + 1; i < 5; i++) n[i] += 1.0;
+	const real increment[5] = { 0.0, probability / 2.0, probability, (1.0 + probability) / 2.0, 1.0 };
+	for (uint i = 0; i < 5; i++) quantile->desired[i] += increment[i];
+
+	//Adjusting heights of middle markers with parabolic or linear prediction
+	for (uint i = 1; i < 4; i++)
+	{
+		real d = quantile->desired[i] - n[i];
+		if ((d >= 1.0 && n[i + 1] - n[i] > 1.0) || (d <= -1.0 && n[i - 1] - n[i] < -1.0))
+		{
+			real s = (d > 0.0) ? 1.0 : -1.0;
+			real parabolic = q[i] + s / (n[i + 1] - n[i - 1]) * (
+				(n[i] - n[i - 1] + s) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) +
+				(n[i + 1] - n[i] - s) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+			if (q[i - 1] < parabolic && parabolic < q[i + 1]) q[i] = parabolic;
+			else
+			{
+				uint j = (s > 0.0) ? i + 1 : i - 1;
+				q[i] = q[i] + s * (q[j] - q[i]) / (n[j] - n[i]);
+			}
+			n[i] += s;
+		}
+	}
+}
+
+p6::real p6::MonteCarlo::_get_quantile(const Quantile *quantile, real probability, uint count) noexcept
+{
+	if (count == 0) return std::numeric_limits<real>::quiet_NaN();
+	if (count >= 5) return quantile->height[2];
+	real height[5];
+	std::copy(quantile->height, quantile->height + count, height);
+	std::sort(height, height + count);
+	return height[(uint)(probability * (count - 1) + 0.5)];
+}
+
+bool p6::MonteCarlo::_simulate_sample(const Construction *mean, uint sample, real *values) const
+{
+	//Sample starts from copy of simulated mean construction, so simulation starts from mean state
+	const uint sticks = mean->get_stick_count();
+	const uint materials = mean->get_material_count();
+	const uint nodes = mean->get_node_count();
+	Construction construction(*mean);
+	construction.set_thread_count(1);
+	for (uint i = 0; i < sticks; i++)
+	{
+		real factor = _lognormal(_seed, sample, i, _area_deviation[i]);
+		if (factor != 1.0) construction.set_stick_area(i, factor * construction.get_stick_area(i));
+	}
+	for (uint i = 0; i < materials; i++)
+	{
+		real factor = _lognormal(_seed, sample, sticks + i, _modulus_deviation[i]);
+		if (factor == 1.0) continue;
+		String name = construction.get_material_name(i);
+		if (construction.get_material_type(i) == Material::Type::linear)
+		{
+			construction.create_linear_material(name, factor * construction.get_material_modulus(i));
+		}
+		else
+		{
+			std::ostringstream formula;
+			formula << std::setprecision(17) << factor << " * (" << construction.get_material_formula(i) << ")";
+			construction.create_nonlinear_material(name, formula.str());
+		}
+	}
+	for (uint i = 0; i < construction.get_force_count(); i++)
+	{
+		real factor = _lognormal(_seed, sample, sticks + materials + i, _force_deviation[i]);
+		if (factor != 1.0) construction.set_force_direction(i, construction.get_force_direction(i) * factor);
+	}
+	try
+	{
+		construction.simulate(true);
+	}
+	catch (const ConvergenceError &)
+	{
+		return false;
+	}
+
+	//Writing values, construction without forces stays undeformed. Displacements refer to mean construction, which is not simulated
+	const bool simulation = construction.get_simulation();
+	for (uint i = 0; i < nodes; i++)
+	{
+		Coord displacement = simulation ? (construction.get_node_coord(i) - mean->get_node_coord(i)) : Coord(0.0, 0.0);
+		values[i] = displacement.x;
+		values[nodes + i] = displacement.y;
+	}
+	for (uint i = 0; i < sticks; i++) values[2 * nodes + i] = simulation ? construction.get_stick_force(i) : 0.0;
+	return true;
+}
+
+void p6::MonteCarlo::_add_sample(bool converged, const real *values) noexcept
+{
+	const uint nodes = _displacement_limit.size();
+	const uint sticks = _force_limit.size();
+	if (!converged) { _failure_count++; return; }
+
+	//Checking limits
+	bool failure = false;
+	for (uint i = 0; i < nodes; i++)
+	{
+		if (Coord(values[i], values[nodes + i]).norm() > _displacement_limit[i]) { _node_failure_count[i]++; failure = true; }
+	}
+	for (uint i = 0; i < sticks; i++)
+	{
+		if (std::abs(values[2 * nodes + i]) > _force_limit[i]) { _stick_failure_count[i]++; failure = true; }
+	}
+	if (failure) _failure_count++;
+
+	//Welford's update of mean and variance
+	for (uint i = 0; i < _mean.size(); i++)
+	{
+		real delta = values[i] - _mean[i];
+		_mean[i] += delta / (_count + 1);
+		_square_sum[i] += delta * (values[i] - _mean[i]);
+		for (uint j = 0; j < _probability.size(); j++) _add_quantile(&_quantile[i * _probability.size() + j], _probability[j], _count, values[i]);
+	}
+	_count++;
+}
+
+void p6::MonteCarlo::simulate()
+{
+	//Resetting statistics
+	const uint nodes = _construction->get_node_count();
+	const uint sticks = _construction->get_stick_count();
+	const uint values = 2 * nodes + sticks;
+	_count = 0;
+	_failure_count = 0;
+	_stick_failure_count.assign(sticks, 0);
+	_node_failure_count.assign(nodes, 0);
+	_mean.assign(values, 0.0);
+	_square_sum.assign(values, 0.0);
+	_quantile.assign(values * _probability.size(), Quantile());
+
+	//Simulating mean construction
+	Construction mean(*_construction);
+	mean.simulate(true);
+	mean.simulate(false);
+
+	//Samples are simulated in parallel in batches and added to statistics in order of samples,
+	//so results do not depend on number of threads. Pool does not forward exceptions, they are rethrown here
+	const uint batch = 256;
+	ThreadPool pool(_construction->get_thread_count());
+	std::vector<real> batch_values(batch * values);
+	std::vector<unsigned char> batch_converged(batch);
+	std::vector<std::exception_ptr> batch_error(batch);
+	for (uint first = 0; first < _sample_count; first += batch)
+	{
+		const uint count = std::min(batch, _sample_count - first);
+		pool.run(count, [&](uint i)
+		{
+			try
+			{
+				batch_converged[i] = _simulate_sample(&mean, first + i, batch_values.data() + i * values) ? 1 : 0;
+			}
+			catch (...)
+			{
+				batch_error[i] = std::current_exception();
+			}
+		});
+		for (uint i = 0; i < count; i++) if (batch_error[i] != nullptr) std::rethrow_exception(batch_error[i]);
+		for (uint i = 0; i < count; i++) _add_sample(batch_converged[i] != 0, batch_values.data() + i * values);
+	}
+}
+
+p6::uint p6::MonteCarlo::get_converged_count() const noexcept
+{
+	return _count;
+}
+
+p6::real p6::MonteCarlo::get_failure_probability() const noexcept
+{
+	return (real)_failure_count / _sample_count;
+}
+
+p6::real p6::MonteCarlo::get_stick_failure_probability(uint stick) const noexcept
+{
+	return (real)_stick_failure_count[stick] / _sample_count;
+}
+
+p6::real p6::MonteCarlo::get_node_failure_probability(uint node) const noexcept
+{
+	return (real)_node_failure_count[node] / _sample_count;
+}
+
+p6::Coord p6::MonteCarlo::get_node_displacement_mean(uint node) const noexcept
+{
+	const uint nodes = _displacement_limit.size();
+	return Coord(_mean[node], _mean[nodes + node]);
+}
+
+p6::Coord p6::MonteCarlo::get_node_displacement_variance(uint node) const noexcept
+{
+	const uint nodes = _displacement_limit.size();
+	if (_count < 2) return Coord(0.0, 0.0);
+	return Coord(_square_sum[node] / (_count - 1), _square_sum[nodes + node] / (_count - 1));
+}
+
+p6::Coord p6::MonteCarlo::get_node_displacement_quantile(uint node, uint quantile) const noexcept
+{
+	const uint nodes = _displacement_limit.size();
+	const uint q = _probability.size();
+	return Coord(
+		_get_quantile(&_quantile[node * q + quantile], _probability[quantile], _count),
+		_get_quantile(&_quantile[(nodes + node) * q + quantile], _probability[quantile], _count));
+}
+
+p6::real p6::MonteCarlo::get_stick_force_mean(uint stick) const noexcept
+{
+	return _mean[2 * _displacement_limit.size() + stick];
+}
+
+p6::real p6::MonteCarlo::get_stick_force_variance(uint stick) const noexcept
+{
+	if (_count < 2) return 0.0;
+	return _square_sum[2 * _displacement_limit.size() + stick] / (_count - 1);
+}
+
+p6::real p6::MonteCarlo::get_stick_force_quantile(uint stick, uint quantile) const noexcept
+{
+	const uint q = _probability.size();
+	return _get_quantile(&_quantile[(2 * _displacement_limit.size() + stick) * q + quantile], _probability[quantile], _count);
+}
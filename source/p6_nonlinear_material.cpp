@@ -234,7 +234,7 @@ p6::real p6::NonlinearMaterial::stress(real strain) const noexcept
 	if (strain != _last_strain)
 	{
 		_last_strain = strain;
-		_calculate();
+		_calculate(strain, &_last_stress, &_last_derivative);
 	}
 	return _last_stress;
 }
@@ -244,12 +244,17 @@ p6::real p6::NonlinearMaterial::derivative(real strain) const noexcept
 	if (strain != _last_strain)
 	{
 		_last_strain = strain;
-		_calculate();
+		_calculate(strain, &_last_stress, &_last_derivative);
 	}
 	return _last_derivative;
 }
 
-void p6::NonlinearMaterial::_calculate() const noexcept
+void p6::NonlinearMaterial::evaluate(real strain, real *stress, real *derivative) const noexcept
+{
+	_calculate(strain, stress, derivative);
+}
+
+void p6::NonlinearMaterial::_calculate(real strain, real *stress, real *derivative) const noexcept
 {
 	std::vector<StackElement> stack;
 
@@ -268,7 +273,7 @@ void p6::NonlinearMaterial::_calculate() const noexcept
 
 		case Operation::PUTS:
 			stack.resize(stack.size() + 1);
-			stack.back().value = _last_strain;
+			stack.back().value = strain;
 			stack.back().derivative = 1.0;
 			break;
 
@@ -335,6 +340,6 @@ void p6::NonlinearMaterial::_calculate() const noexcept
 	assert(stack.size() == 1);
 
 	//Saving result
-	_last_stress = stack[0].value;
-	_last_derivative = stack[0].derivative;
+	*stress = stack[0].value;
+	*derivative = stack[0].derivative;
 }
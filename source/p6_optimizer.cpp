@@ -0,0 +1,315 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#include "../header/p6_optimizer.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+p6::Optimizer::Optimizer(Construction *construction) noexcept : _construction(construction)
+{
+}
+
+void p6::Optimizer::set_max_length(real length) noexcept
+{
+	assert(length > 0.0);
+	_max_length = length;
+}
+
+void p6::Optimizer::set_material(uint material) noexcept
+{
+	assert(material < _construction->get_material_count());
+	_material = material;
+}
+
+void p6::Optimizer::set_initial_area(real area) noexcept
+{
+	assert(area > 0.0);
+	_initial_area = area;
+}
+
+void p6::Optimizer::set_volume_limit(real volume) noexcept
+{
+	assert(volume >= 0.0);
+	_volume_limit = volume;
+}
+
+void p6::Optimizer::set_stress_limit(real stress) noexcept
+{
+	assert(stress >= 0.0);
+	_stress_limit = stress;
+}
+
+void p6::Optimizer::set_min_area(real area) noexcept
+{
+	assert(area > 0.0);
+	_min_area = area;
+}
+
+void p6::Optimizer::set_removal_ratio(real ratio) noexcept
+{
+	assert(ratio >= 0.0 && ratio < 1.0);
+	_removal_ratio = ratio;
+}
+
+void p6::Optimizer::set_max_iterations(uint iterations) noexcept
+{
+	_max_iterations = iterations;
+}
+
+void p6::Optimizer::set_tolerance(real tolerance) noexcept
+{
+	assert(tolerance > 0.0);
+	_tolerance = tolerance;
+}
+
+p6::uint p6::Optimizer::generate()
+{
+	_construction->simulate(false);
+	const uint nodes = _construction->get_node_count();
+	if (nodes < 2) return 0;
+	if (_material >= _construction->get_material_count()) throw std::runtime_error("Material is not specified");
+
+	//Grid of cells not smaller than largest length, so neighbors of node lie in 3x3 cells around it, number of cells does not exceed number of nodes
+	Coord low = _construction->get_node_coord(0), high = low;
+	for (uint i = 1; i < nodes; i++)
+	{
+		Coord coord = _construction->get_node_coord(i);
+		low = Coord(std::min(low.x, coord.x), std::min(low.y, coord.y));
+		high = Coord(std::max(high.x, coord.x), std::max(high.y, coord.y));
+	}
+	const real side = std::ceil(std::sqrt((real)nodes));
+	const real cell = std::max(_max_length, std::max(high.x - low.x, high.y - low.y) / side);
+	const uint width = (uint)((high.x - low.x) / cell) + 1;
+	const uint height = (uint)((high.y - low.y) / cell) + 1;
+
+	//Counting sort of nodes by cells, keeping nodes in original order inside cell
+	std::vector<uint> node_cell(nodes), cell_offset(width * height + 1, 0), cell_node(nodes);
+	for (uint i = 0; i < nodes; i++)
+	{
+		Coord coord = _construction->get_node_coord(i);
+		const uint x = std::min((uint)((coord.x - low.x) / cell), width - 1);
+		const uint y = std::min((uint)((coord.y - low.y) / cell), height - 1);
+		node_cell[i] = y * width + x;
+		cell_offset[node_cell[i] + 1]++;
+	}
+	for (uint i = 0; i < width * height; i++) cell_offset[i + 1] += cell_offset[i];
+	std::vector<uint> position(cell_offset.begin(), cell_offset.end() - 1);
+	for (uint i = 0; i < nodes; i++) cell_node[position[node_cell[i]]++] = i;
+
+	//Existing sticks are not created again
+	std::vector<std::pair<uint, uint>> existing(_construction->get_stick_count());
+	for (uint i = 0; i < existing.size(); i++)
+	{
+		uint node[2];
+		_construction->get_stick_node(i, node);
+		existing[i] = std::make_pair(std::min(node[0], node[1]), std::max(node[0], node[1]));
+	}
+	std::sort(existing.begin(), existing.end());
+
+	//Sticks between fixed nodes carry nothing and are not created
+	std::vector<uint> pair;
+	for (uint i = 0; i < nodes; i++)
+	{
+		Coord coord = _construction->get_node_coord(i);
+		const uint x = node_cell[i] % width;
+		const uint y = node_cell[i] / width;
+		for (uint cy = (y > 0) ? y - 1 : 0; cy <= y + 1 && cy < height; cy++)
+		{
+			for (uint cx = (x > 0) ? x - 1 : 0; cx <= x + 1 && cx < width; cx++)
+			{
+				for (uint k = cell_offset[cy * width + cx]; k < cell_offset[cy * width + cx + 1]; k++)
+				{
+					const uint j = cell_node[k];
+					if (j <= i) continue;
+					if (_construction->get_node_freedom(i) == 0 && _construction->get_node_freedom(j) == 0) continue;
+					const real distance = coord.distance(_construction->get_node_coord(j));
+					if (distance > _max_length || distance == 0.0) continue;
+					if (std::binary_search(existing.begin(), existing.end(), std::make_pair(i, j))) continue;
+					pair.push_back(i);
+					pair.push_back(j);
+				}
+			}
+		}
+	}
+	_construction->create_sticks(&pair, _material, _initial_area);
+	return pair.size() / 2;
+}
+
+p6::real p6::Optimizer::_update_areas(const std::vector<real> *sensitivity, const std::vector<real> *force, real volume_limit, std::vector<real> *area) const noexcept
+{
+	//Optimality criteria: new area is a * sqrt(-dC/da / (lambda * L)) limited to [a / 2, 2 * a],
+	//stress limit makes area at least |F| / s, lagrange multiplier is found with bisection to reach volume limit.
+	//Stress of vanishing sticks is determined by others, so it is not limited for sticks that would be removed
+	const real move = 2.0;
+	const uint sticks = area->size();
+	real thickest = 0.0;
+	for (uint i = 0; i < sticks; i++) thickest = std::max(thickest, area->at(i));
+	std::vector<real> scaled(sticks), lower(sticks), upper(sticks);
+	real lower_volume = 0.0, upper_volume = 0.0;
+	real low = std::numeric_limits<real>::infinity(), high = 0.0;
+	for (uint i = 0; i < sticks; i++)
+	{
+		scaled[i] = area->at(i) * std::sqrt(std::max(-sensitivity->at(i), 0.0) / _length[i]);
+		lower[i] = std::max(_min_area, area->at(i) / move);
+		if (_stress_limit > 0.0 && area->at(i) >= _removal_ratio * thickest) lower[i] = std::max(lower[i], std::abs(force->at(i)) / _stress_limit);
+		upper[i] = std::max(area->at(i) * move, lower[i]);
+		lower_volume += lower[i] * _length[i];
+		upper_volume += upper[i] * _length[i];
+		if (scaled[i] > 0.0)
+		{
+			low = std::min(low, lower[i] / scaled[i]);
+			high = std::max(high, upper[i] / scaled[i]);
+		}
+	}
+
+	//Volume is increasing function of multiplier's inverse square root
+	real multiplier;
+	if (lower_volume >= volume_limit || high == 0.0) multiplier = 0.0;
+	else if (upper_volume <= volume_limit) multiplier = std::numeric_limits<real>::infinity();
+	else
+	{
+		for (uint b = 0; b < 200 && high > low * (1.0 + 1e-12); b++)
+		{
+			multiplier = std::sqrt(low * high);
+			real volume = 0.0;
+			for (uint i = 0; i < sticks; i++) volume += std::min(std::max(scaled[i] * multiplier, lower[i]), upper[i]) * _length[i];
+			if (volume > volume_limit) high = multiplier;
+			else low = multiplier;
+		}
+		multiplier = std::sqrt(low * high);
+	}
+
+	real change = 0.0, largest = 0.0;
+	for (uint i = 0; i < sticks; i++)
+	{
+		real updated;
+		if (multiplier == 0.0) updated = lower[i];
+		else if (multiplier == std::numeric_limits<real>::infinity()) updated = upper[i];
+		else updated = std::min(std::max(scaled[i] * multiplier, lower[i]), upper[i]);
+		change = std::max(change, std::abs(updated - area->at(i)));
+		largest = std::max(largest, updated);
+		area->at(i) = updated;
+	}
+	return (largest > 0.0) ? change / largest : 0.0;
+}
+
+void p6::Optimizer::_remove_sticks(std::vector<real> *area) noexcept
+{
+	real largest = 0.0;
+	for (uint i = 0; i < area->size(); i++) largest = std::max(largest, area->at(i));
+	std::vector<uint> removed;
+	uint kept = 0;
+	for (uint i = 0; i < area->size(); i++)
+	{
+		if (area->at(i) < _removal_ratio * largest) { removed.push_back(i); continue; }
+		area->at(kept) = area->at(i);
+		_length[kept] = _length[i];
+		kept++;
+	}
+	area->resize(kept);
+	_length.resize(kept);
+	_construction->delete_sticks(&removed);
+
+	//Unloaded nodes left without sticks or with one stick would make derivative singular, they are fixed,
+	//unloaded free nodes between collinear sticks would be singular across sticks, they are put on rail along sticks
+	const uint nodes = _construction->get_node_count();
+	std::vector<uint> count(nodes, 0);
+	std::vector<Coord> direction(nodes);
+	std::vector<unsigned char> collinear(nodes, 1);
+	for (uint i = 0; i < _construction->get_stick_count(); i++)
+	{
+		uint node[2];
+		_construction->get_stick_node(i, node);
+		Coord vector = _construction->get_node_coord(node[1]) - _construction->get_node_coord(node[0]);
+		vector = vector / vector.norm();
+		for (uint j = 0; j < 2; j++)
+		{
+			if (count[node[j]] == 0) direction[node[j]] = vector;
+			else if (std::abs(direction[node[j]].x * vector.y - direction[node[j]].y * vector.x) > 1e-9) collinear[node[j]] = 0;
+			count[node[j]]++;
+		}
+	}
+	for (uint i = 0; i < _construction->get_force_count(); i++) count[_construction->get_force_node(i)] = (uint)-1;
+	for (uint i = 0; i < nodes; i++)
+	{
+		if (count[i] == (uint)-1 || _construction->get_node_freedom(i) == 0) continue;
+		if (count[i] < 2) _construction->set_node_freedom(i, 0);
+		else if (collinear[i] && _construction->get_node_freedom(i) == 2)
+		{
+			_construction->set_node_freedom(i, 1);
+			_construction->set_node_rail_vector(i, direction[i]);
+		}
+	}
+}
+
+bool p6::Optimizer::optimize()
+{
+	if (_construction->get_force_count() == 0) throw std::runtime_error("Construction has no forces");
+	_construction->simulate(false);
+	const uint nodes = _construction->get_node_count();
+	const uint sticks = _construction->get_stick_count();
+	std::vector<Coord> initial(nodes);
+	for (uint i = 0; i < nodes; i++) initial[i] = _construction->get_node_coord(i);
+	std::vector<real> area(sticks);
+	_length.resize(sticks);
+	real volume = 0.0;
+	for (uint i = 0; i < sticks; i++)
+	{
+		area[i] = _construction->get_stick_area(i);
+		_length[i] = _construction->get_stick_length(i);
+		volume += area[i] * _length[i];
+	}
+	const real volume_limit = (_volume_limit > 0.0) ? _volume_limit : volume;
+
+	//Areas only change between iterations, so every simulation starts from previous equilibrium.
+	//Compliance's derivatives reuse factorization of the last Newton iteration only if it belongs to equilibrium,
+	//with default early exit sensitivity analysis assembles and factorizes derivative once more
+	std::vector<real> sensitivity, force(sticks);
+	std::vector<Coord> coord_sensitivity;
+	bool converged = false;
+	for (_iterations = 0; _iterations < _max_iterations && !converged; _iterations++)
+	{
+		_construction->simulate(true);
+		_compliance = 0.0;
+		for (uint i = 0; i < _construction->get_force_count(); i++)
+		{
+			const uint node = _construction->get_force_node(i);
+			_compliance += _construction->get_force_direction(i).dot(_construction->get_node_coord(node) - initial[node]);
+		}
+		_construction->get_sensitivity(Construction::Response::compliance, 0, Coord(), &sensitivity, &coord_sensitivity);
+		for (uint i = 0; i < sticks; i++) force[i] = _construction->get_stick_force(i);
+		_construction->simulate(false);
+		converged = _update_areas(&sensitivity, &force, volume_limit, &area) < _tolerance;
+		for (uint i = 0; i < sticks; i++) _construction->set_stick_area(i, area[i]);
+	}
+	_remove_sticks(&area);
+	return converged;
+}
+
+p6::uint p6::Optimizer::get_iteration_count() const noexcept
+{
+	return _iterations;
+}
+
+p6::real p6::Optimizer::get_compliance() const noexcept
+{
+	return _compliance;
+}
+
+p6::real p6::Optimizer::get_volume() const noexcept
+{
+	real volume = 0.0;
+	for (uint i = 0; i < _length.size(); i++) volume += _construction->get_stick_area(i) * _length[i];
+	return volume;
+}
@@ -0,0 +1,260 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#include "../header/p6_preconditioner.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+void p6::Preconditioner::analyze(const SparseMatrix &)
+{}
+
+p6::Preconditioner::~Preconditioner() noexcept
+{}
+
+void p6::JacobiPreconditioner::factorize(const SparseMatrix &matrix)
+{
+	factorize(DenseVector(matrix.diagonal()));
+}
+
+void p6::JacobiPreconditioner::factorize(const DenseVector &diagonal)
+{
+	_inverse_diagonal.resize(diagonal.size());
+	for (uint i = 0; i < (uint)diagonal.size(); i++)
+	{
+		_inverse_diagonal(i) = (diagonal(i) > 0.0) ? 1.0 / diagonal(i) : 1.0;
+	}
+}
+
+void p6::JacobiPreconditioner::apply(const DenseVector &right, DenseVector *solution) const
+{
+	*solution = _inverse_diagonal.cwiseProduct(right);
+}
+
+void p6::CholeskyPreconditioner::analyze(const SparseMatrix &matrix)
+{
+	_cholesky.analyzePattern(matrix);
+}
+
+void p6::CholeskyPreconditioner::factorize(const SparseMatrix &matrix)
+{
+	_cholesky.factorize(matrix);
+	if (_cholesky.info() != Eigen::Success) throw std::runtime_error("Incomplete Cholesky factorization failed");
+}
+
+void p6::CholeskyPreconditioner::apply(const DenseVector &right, DenseVector *solution) const
+{
+	*solution = _cholesky.solve(right);
+}
+
+void p6::AMGPreconditioner::set_null_space(const DenseMatrix &null_space, const std::vector<uint> &block)
+{
+	_null_space = null_space;
+	_block = block;
+}
+
+void p6::AMGPreconditioner::_aggregate(const SparseMatrix &matrix, const std::vector<uint> &block, uint block_count,
+	std::vector<uint> *aggregate, uint *count) const
+{
+	//Blocks I and J are strongly connected if s_IJ >= theta * sqrt(s_II * s_JJ), where s_IJ = sum(|a_ij|), i in I, j in J
+	const real theta = 0.08;
+	TripletVector triplets;
+	for (uint j = 0; j < (uint)matrix.outerSize(); j++)
+	{
+		for (SparseMatrix::InnerIterator i(matrix, j); i; ++i) triplets.push_back(Eigen::Triplet<real>(block[i.row()], block[j], std::abs(i.value())));
+	}
+	SparseMatrix connection(block_count, block_count);
+	connection.setFromTriplets(triplets.begin(), triplets.end());
+	const DenseVector diagonal = connection.diagonal();
+	std::vector<uint> strong_offset(block_count + 1, 0), strong;
+	for (uint i = 0; i < block_count; i++)
+	{
+		for (SparseMatrix::InnerIterator j(connection, i); j; ++j)
+		{
+			if ((uint)j.row() != i && sqr(j.value()) >= sqr(theta) * diagonal(i) * diagonal(j.row())) strong.push_back(j.row());
+		}
+		strong_offset[i + 1] = strong.size();
+	}
+
+	//First pass: blocks with completely free neighborhoods become aggregate roots
+	const uint none = (uint)-1;
+	aggregate->assign(block_count, none);
+	*count = 0;
+	for (uint i = 0; i < block_count; i++)
+	{
+		if (aggregate->at(i) != none) continue;
+		bool free = true;
+		for (uint j = strong_offset[i]; j < strong_offset[i + 1] && free; j++) free = aggregate->at(strong[j]) == none;
+		if (!free) continue;
+		aggregate->at(i) = *count;
+		for (uint j = strong_offset[i]; j < strong_offset[i + 1]; j++) aggregate->at(strong[j]) = *count;
+		(*count)++;
+	}
+
+	//Second pass: remaining blocks join neighboring aggregates from the first pass
+	const std::vector<uint> first = *aggregate;
+	for (uint i = 0; i < block_count; i++)
+	{
+		if (aggregate->at(i) != none) continue;
+		for (uint j = strong_offset[i]; j < strong_offset[i + 1]; j++)
+		{
+			if (first[strong[j]] != none) { aggregate->at(i) = first[strong[j]]; break; }
+		}
+	}
+
+	//Third pass: leftovers are grouped with their unaggregated neighbors
+	for (uint i = 0; i < block_count; i++)
+	{
+		if (aggregate->at(i) != none) continue;
+		aggregate->at(i) = *count;
+		for (uint j = strong_offset[i]; j < strong_offset[i + 1]; j++)
+		{
+			if (aggregate->at(strong[j]) == none) aggregate->at(strong[j]) = *count;
+		}
+		(*count)++;
+	}
+}
+
+void p6::AMGPreconditioner::factorize(const SparseMatrix &matrix)
+{
+	const uint coarse_size = 500;
+	const uint max_levels = 20;
+	_level.resize(1);
+	_level[0].matrix = matrix;
+
+	//Near null space and blocks, constants and single unknowns if not given
+	typedef Eigen::Matrix<real, Eigen::Dynamic, Eigen::Dynamic> Dense;
+	Dense null_space;
+	std::vector<uint> block;
+	uint block_count;
+	if ((uint)_null_space.rows() == (uint)matrix.rows() && _block.size() == (uint)matrix.rows())
+	{
+		null_space = _null_space;
+		block = _block;
+		block_count = block.empty() ? 0 : (*std::max_element(block.begin(), block.end()) + 1);
+	}
+	else
+	{
+		null_space = Dense::Ones(matrix.rows(), 1);
+		block_count = matrix.rows();
+		block.resize(block_count);
+		for (uint i = 0; i < block_count; i++) block[i] = i;
+	}
+
+	while (true)
+	{
+		//Computing smoother
+		Level *level = &_level.back();
+		const uint size = level->matrix.rows();
+		const DenseVector diagonal = level->matrix.diagonal();
+		level->inverse_diagonal.resize(size);
+		real radius = 0.0; //Gershgorin estimate of spectral radius of D^-1 * A
+		for (uint i = 0; i < size; i++)
+		{
+			level->inverse_diagonal(i) = (diagonal(i) > 0.0) ? 1.0 / diagonal(i) : 1.0;
+			real row = 0.0;
+			for (SparseMatrix::InnerIterator j(level->matrix, i); j; ++j) row += std::abs(j.value());
+			radius = std::max(radius, row * level->inverse_diagonal(i));
+		}
+		level->weight = (radius > 0.0) ? 4.0 / (3.0 * radius) : 1.0;
+		level->right.resize(size);
+		level->solution.resize(size);
+		level->residual.resize(size);
+		if (size <= coarse_size || _level.size() == max_levels) break;
+
+		//Aggregating blocks
+		std::vector<uint> aggregate;
+		uint count;
+		_aggregate(level->matrix, block, block_count, &aggregate, &count);
+		if (count == 0 || 4 * count > 3 * block_count) break; //Coarsening stagnates
+
+		//Sorting unknowns by aggregates
+		std::vector<uint> member_offset(count + 1, 0), member(size);
+		for (uint i = 0; i < size; i++) member_offset[aggregate[block[i]] + 1]++;
+		for (uint a = 0; a < count; a++) member_offset[a + 1] += member_offset[a];
+		{
+			std::vector<uint> position(member_offset.begin(), member_offset.end() - 1);
+			for (uint i = 0; i < size; i++) member[position[aggregate[block[i]]]++] = i;
+		}
+
+		//Tentative prolongation: orthonormalized restriction of null space to every aggregate, B_a = Q * R
+		TripletVector triplets;
+		std::vector<Dense> coarse_rows;
+		std::vector<uint> coarse_block;
+		for (uint a = 0; a < count; a++)
+		{
+			const uint rows = member_offset[a + 1] - member_offset[a];
+			Dense local(rows, null_space.cols());
+			for (uint k = 0; k < rows; k++) local.row(k) = null_space.row(member[member_offset[a] + k]);
+			Eigen::ColPivHouseholderQR<Dense> qr(local);
+			const uint rank = qr.rank();
+			const Dense q = qr.householderQ() * Dense::Identity(rows, rank);
+			const Dense r = Dense(qr.matrixR().topRows(rank).template triangularView<Eigen::Upper>()) * qr.colsPermutation().transpose();
+			for (uint c = 0; c < rank; c++)
+			{
+				for (uint k = 0; k < rows; k++) triplets.push_back(Eigen::Triplet<real>(member[member_offset[a] + k], coarse_block.size(), q(k, c)));
+				coarse_rows.push_back(r.row(c));
+				coarse_block.push_back(a);
+			}
+		}
+		SparseMatrix tentative(size, coarse_block.size());
+		tentative.setFromTriplets(triplets.begin(), triplets.end());
+		null_space.resize(coarse_block.size(), null_space.cols());
+		for (uint i = 0; i < coarse_block.size(); i++) null_space.row(i) = coarse_rows[i];
+		block = coarse_block;
+		block_count = count;
+
+		//Smoothing prolongation with one damped Jacobi step, P = (I - w * D^-1 * A) * P0
+		SparseMatrix scaled = SparseMatrix(level->weight * level->inverse_diagonal.asDiagonal() * level->matrix);
+		level->prolongation = SparseMatrix(tentative - scaled * tentative);
+		level->restriction = SparseMatrix(level->prolongation.transpose());
+
+		//Galerkin coarse matrix
+		Level next;
+		next.matrix = SparseMatrix(level->restriction * (level->matrix * level->prolongation));
+		_level.push_back(next);
+	}
+	_coarse.compute(_level.back().matrix);
+	if (_coarse.info() != Eigen::Success) throw std::runtime_error("Multigrid coarse factorization failed");
+}
+
+void p6::AMGPreconditioner::_smooth(const Level &level, uint count) const noexcept
+{
+	for (uint i = 0; i < count; i++)
+	{
+		level.residual = level.right - level.matrix * level.solution;
+		level.solution += level.weight * level.inverse_diagonal.cwiseProduct(level.residual);
+	}
+}
+
+void p6::AMGPreconditioner::_cycle(uint index) const noexcept
+{
+	const Level &level = _level[index];
+	if (index + 1 == _level.size())
+	{
+		level.solution = _coarse.solve(level.right);
+		return;
+	}
+	const uint sweeps = 2;
+	level.solution.setZero();
+	_smooth(level, sweeps);
+	level.residual = level.right - level.matrix * level.solution;
+	_level[index + 1].right = level.restriction * level.residual;
+	_cycle(index + 1);
+	level.solution += level.prolongation * _level[index + 1].solution;
+	_smooth(level, sweeps);
+}
+
+void p6::AMGPreconditioner::apply(const DenseVector &right, DenseVector *solution) const
+{
+	_level[0].right = right;
+	_cycle(0);
+	*solution = _level[0].solution;
+}
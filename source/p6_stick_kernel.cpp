@@ -0,0 +1,165 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#include "../header/p6_stick_kernel.hpp"
+#include <cmath>
+
+//Vector functions are compiled for their instruction sets with target attributes, so the binary runs
+//on any x86-64 processor. Operations follow the scalar order and are never fused, results are identical
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+	#define P6_STICK_KERNEL_X86
+	#include <immintrin.h>
+#endif
+
+p6::StickKernel::Function *p6::StickKernel::_function = p6::StickKernel::_get_function(p6::StickKernel::get_supported_level());
+
+void p6::StickKernel::_evaluate_scalar(const Batch *batch, uint begin) noexcept
+{
+	for (uint i = begin; i < batch->count; i++)
+	{
+		const uint stick = batch->stick[i];
+		const real length = sqrt(batch->dx[i] * batch->dx[i] + batch->dy[i] * batch->dy[i]);
+		const real initial_length = batch->initial_length[stick];
+		const real tension = batch->area[stick] * (batch->modulus[stick] * ((length - initial_length) / initial_length));
+		const real ex = batch->dx[i] / length;
+		const real ey = batch->dy[i] / length;
+		batch->ex[i] = ex;
+		batch->ey[i] = ey;
+		batch->length[i] = length;
+		batch->tension[i] = tension;
+		if (batch->kxx == nullptr) continue;
+		real dtension = batch->area[stick] * batch->modulus[stick] / initial_length;
+		if (dtension == 0.0) dtension = batch->area[stick] / initial_length;
+		const real tension_length = tension / length;
+		batch->kxx[i] = dtension * ex * ex + tension_length * (1.0 - ex * ex);
+		batch->kxy[i] = dtension * ex * ey - tension_length * ex * ey;
+		batch->kyy[i] = dtension * ey * ey + tension_length * (1.0 - ey * ey);
+	}
+}
+
+#ifdef P6_STICK_KERNEL_X86
+__attribute__((target("avx2")))
+#endif
+void p6::StickKernel::_evaluate_avx2(const Batch *batch) noexcept
+{
+	uint i = 0;
+	#ifdef P6_STICK_KERNEL_X86
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d one = _mm256_set1_pd(1.0);
+	for (; i + 4 <= batch->count; i += 4)
+	{
+		const __m256i stick = _mm256_loadu_si256((const __m256i*)(batch->stick + i));
+		const __m256d dx = _mm256_loadu_pd(batch->dx + i);
+		const __m256d dy = _mm256_loadu_pd(batch->dy + i);
+		const __m256d initial_length = _mm256_i64gather_pd(batch->initial_length, stick, 8);
+		const __m256d area = _mm256_i64gather_pd(batch->area, stick, 8);
+		const __m256d modulus = _mm256_i64gather_pd(batch->modulus, stick, 8);
+		const __m256d length = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+		const __m256d strain = _mm256_div_pd(_mm256_sub_pd(length, initial_length), initial_length);
+		const __m256d tension = _mm256_mul_pd(area, _mm256_mul_pd(modulus, strain));
+		const __m256d ex = _mm256_div_pd(dx, length);
+		const __m256d ey = _mm256_div_pd(dy, length);
+		_mm256_storeu_pd(batch->ex + i, ex);
+		_mm256_storeu_pd(batch->ey + i, ey);
+		_mm256_storeu_pd(batch->length + i, length);
+		_mm256_storeu_pd(batch->tension + i, tension);
+		if (batch->kxx == nullptr) continue;
+		__m256d dtension = _mm256_div_pd(_mm256_mul_pd(area, modulus), initial_length);
+		dtension = _mm256_blendv_pd(dtension, _mm256_div_pd(area, initial_length), _mm256_cmp_pd(dtension, zero, _CMP_EQ_OQ));
+		const __m256d tension_length = _mm256_div_pd(tension, length);
+		const __m256d dtension_ex = _mm256_mul_pd(dtension, ex);
+		_mm256_storeu_pd(batch->kxx + i, _mm256_add_pd(_mm256_mul_pd(dtension_ex, ex), _mm256_mul_pd(tension_length, _mm256_sub_pd(one, _mm256_mul_pd(ex, ex)))));
+		_mm256_storeu_pd(batch->kxy + i, _mm256_sub_pd(_mm256_mul_pd(dtension_ex, ey), _mm256_mul_pd(_mm256_mul_pd(tension_length, ex), ey)));
+		_mm256_storeu_pd(batch->kyy + i, _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(dtension, ey), ey), _mm256_mul_pd(tension_length, _mm256_sub_pd(one, _mm256_mul_pd(ey, ey)))));
+	}
+	#endif
+	_evaluate_scalar(batch, i);
+}
+
+#ifdef P6_STICK_KERNEL_X86
+__attribute__((target("avx512f")))
+#endif
+void p6::StickKernel::_evaluate_avx512(const Batch *batch) noexcept
+{
+	uint i = 0;
+	#ifdef P6_STICK_KERNEL_X86
+	//Masked forms keep GCC from warning about undefined source vectors
+	const __m512d zero = _mm512_setzero_pd();
+	const __m512d one = _mm512_set1_pd(1.0);
+	for (; i + 8 <= batch->count; i += 8)
+	{
+		const __m512i stick = _mm512_loadu_si512((const void*)(batch->stick + i));
+		const __m512d dx = _mm512_loadu_pd(batch->dx + i);
+		const __m512d dy = _mm512_loadu_pd(batch->dy + i);
+		const __m512d initial_length = _mm512_mask_i64gather_pd(zero, 0xFF, stick, batch->initial_length, 8);
+		const __m512d area = _mm512_mask_i64gather_pd(zero, 0xFF, stick, batch->area, 8);
+		const __m512d modulus = _mm512_mask_i64gather_pd(zero, 0xFF, stick, batch->modulus, 8);
+		const __m512d length = _mm512_maskz_sqrt_pd(0xFF, _mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy)));
+		const __m512d strain = _mm512_div_pd(_mm512_sub_pd(length, initial_length), initial_length);
+		const __m512d tension = _mm512_mul_pd(area, _mm512_mul_pd(modulus, strain));
+		const __m512d ex = _mm512_div_pd(dx, length);
+		const __m512d ey = _mm512_div_pd(dy, length);
+		_mm512_storeu_pd(batch->ex + i, ex);
+		_mm512_storeu_pd(batch->ey + i, ey);
+		_mm512_storeu_pd(batch->length + i, length);
+		_mm512_storeu_pd(batch->tension + i, tension);
+		if (batch->kxx == nullptr) continue;
+		__m512d dtension = _mm512_div_pd(_mm512_mul_pd(area, modulus), initial_length);
+		dtension = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(dtension, zero, _CMP_EQ_OQ), dtension, _mm512_div_pd(area, initial_length));
+		const __m512d tension_length = _mm512_div_pd(tension, length);
+		const __m512d dtension_ex = _mm512_mul_pd(dtension, ex);
+		_mm512_storeu_pd(batch->kxx + i, _mm512_add_pd(_mm512_mul_pd(dtension_ex, ex), _mm512_mul_pd(tension_length, _mm512_sub_pd(one, _mm512_mul_pd(ex, ex)))));
+		_mm512_storeu_pd(batch->kxy + i, _mm512_sub_pd(_mm512_mul_pd(dtension_ex, ey), _mm512_mul_pd(_mm512_mul_pd(tension_length, ex), ey)));
+		_mm512_storeu_pd(batch->kyy + i, _mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(dtension, ey), ey), _mm512_mul_pd(tension_length, _mm512_sub_pd(one, _mm512_mul_pd(ey, ey)))));
+	}
+	#endif
+	_evaluate_scalar(batch, i);
+}
+
+void p6::StickKernel::_evaluate_none(const Batch *batch) noexcept
+{
+	_evaluate_scalar(batch, 0);
+}
+
+p6::StickKernel::Function *p6::StickKernel::_get_function(Level level) noexcept
+{
+	if (level == Level::avx512) return _evaluate_avx512;
+	else if (level == Level::avx2) return _evaluate_avx2;
+	else return _evaluate_none;
+}
+
+p6::StickKernel::Level p6::StickKernel::get_supported_level() noexcept
+{
+	#ifdef P6_STICK_KERNEL_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f")) return Level::avx512;
+		if (__builtin_cpu_supports("avx2")) return Level::avx2;
+	#endif
+	return Level::scalar;
+}
+
+p6::StickKernel::Level p6::StickKernel::get_level() noexcept
+{
+	if (_function == _evaluate_avx512) return Level::avx512;
+	else if (_function == _evaluate_avx2) return Level::avx2;
+	else return Level::scalar;
+}
+
+void p6::StickKernel::set_level(Level level) noexcept
+{
+	const Level supported = get_supported_level();
+	if (level > supported) level = supported;
+	_function = _get_function(level);
+}
+
+void p6::StickKernel::evaluate(const Batch *batch) noexcept
+{
+	_function(batch);
+}
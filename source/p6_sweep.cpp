@@ -0,0 +1,169 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#include "../header/p6_sweep.hpp"
+#include "../header/p6_thread_pool.hpp"
+#include <cassert>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+
+p6::Sweep::Sweep(const Construction *construction) noexcept : _construction(construction)
+{
+}
+
+p6::uint p6::Sweep::create_variant() noexcept
+{
+	_override.push_back(std::vector<Override>());
+	return _override.size() - 1;
+}
+
+p6::uint p6::Sweep::get_variant_count() const noexcept
+{
+	return _override.size();
+}
+
+void p6::Sweep::set_stick_area(uint variant, uint stick, real area) noexcept
+{
+	assert(stick < _construction->get_stick_count());
+	Override o;
+	o.parameter = Parameter::stick_area;
+	o.index = stick;
+	o.value = area;
+	_override[variant].push_back(o);
+}
+
+void p6::Sweep::set_material_modulus(uint variant, uint material, real modulus) noexcept
+{
+	assert(material < _construction->get_material_count());
+	Override o;
+	o.parameter = Parameter::material_modulus;
+	o.index = material;
+	o.value = modulus;
+	_override[variant].push_back(o);
+}
+
+void p6::Sweep::set_material_formula(uint variant, uint material, const String formula) noexcept
+{
+	assert(material < _construction->get_material_count());
+	Override o;
+	o.parameter = Parameter::material_formula;
+	o.index = material;
+	o.formula = formula;
+	_override[variant].push_back(o);
+}
+
+void p6::Sweep::set_node_coord(uint variant, uint node, Coord coord) noexcept
+{
+	assert(node < _construction->get_node_count());
+	Override o;
+	o.parameter = Parameter::node_coord;
+	o.index = node;
+	o.coord = coord;
+	_override[variant].push_back(o);
+}
+
+void p6::Sweep::set_force_magnitude(uint variant, uint force, real magnitude) noexcept
+{
+	assert(force < _construction->get_force_count());
+	Override o;
+	o.parameter = Parameter::force_magnitude;
+	o.index = force;
+	o.value = magnitude;
+	_override[variant].push_back(o);
+}
+
+void p6::Sweep::_simulate_variant(uint variant)
+{
+	//Every variant is simulated on it's own copy, serially, since variants are simulated in parallel
+	Construction construction(*_construction);
+	construction.set_thread_count(1);
+	const uint nodes = construction.get_node_count();
+	std::vector<Coord> initial(nodes);
+	try
+	{
+		//Simulated base is copied with deformed coordinates, overrides and displacements refer to undeformed ones
+		construction.simulate(false);
+		for (uint i = 0; i < _override[variant].size(); i++)
+		{
+			const Override &o = _override[variant][i];
+			if (o.parameter == Parameter::stick_area) construction.set_stick_area(o.index, o.value);
+			else if (o.parameter == Parameter::material_modulus) construction.create_linear_material(construction.get_material_name(o.index), o.value);
+			else if (o.parameter == Parameter::material_formula) construction.create_nonlinear_material(construction.get_material_name(o.index), o.formula);
+			else if (o.parameter == Parameter::node_coord) construction.set_node_coord(o.index, o.coord);
+			else
+			{
+				Coord direction = construction.get_force_direction(o.index);
+				const real norm = direction.norm();
+				if (norm != 0.0) construction.set_force_direction(o.index, direction * (o.value / norm));
+				else if (o.value != 0.0) throw std::runtime_error("Force without direction can not be scaled");
+			}
+		}
+		for (uint i = 0; i < nodes; i++) initial[i] = construction.get_node_coord(i);
+		construction.simulate(true);
+	}
+	catch (const ConvergenceError &)
+	{
+		return;
+	}
+
+	//Writing results to columns, construction without forces stays undeformed
+	const uint variants = _override.size();
+	const bool simulation = construction.get_simulation();
+	for (uint i = 0; i < nodes; i++)
+	{
+		Coord displacement = construction.get_node_coord(i) - initial[i];
+		_result[(i        ) * variants + variant] = displacement.x;
+		_result[(nodes + i) * variants + variant] = displacement.y;
+	}
+	for (uint i = 0; i < construction.get_stick_count(); i++)
+	{
+		_result[(2 * nodes + i) * variants + variant] = simulation ? construction.get_stick_force(i) : 0.0;
+	}
+	_converged[variant] = 1;
+}
+
+void p6::Sweep::simulate()
+{
+	const uint variants = _override.size();
+	_converged.assign(variants, 0);
+	_result.assign((2 * _construction->get_node_count() + _construction->get_stick_count()) * variants, std::numeric_limits<real>::quiet_NaN());
+	ThreadPool pool(_construction->get_thread_count());
+	std::vector<std::exception_ptr> error(variants);
+	pool.run(variants, [&](uint variant)
+	{
+		//Pool does not forward exceptions, they are rethrown after all variants are simulated
+		try
+		{
+			_simulate_variant(variant);
+		}
+		catch (...)
+		{
+			error[variant] = std::current_exception();
+		}
+	});
+	for (uint i = 0; i < variants; i++) if (error[i] != nullptr) std::rethrow_exception(error[i]);
+}
+
+bool p6::Sweep::get_converged(uint variant) const noexcept
+{
+	return _converged[variant] != 0;
+}
+
+const p6::real *p6::Sweep::get_node_displacement(uint node, unsigned int axis) const noexcept
+{
+	assert(axis < 2);
+	return _result.data() + (axis * _construction->get_node_count() + node) * _override.size();
+}
+
+const p6::real *p6::Sweep::get_stick_force(uint stick) const noexcept
+{
+	return _result.data() + (2 * _construction->get_node_count() + stick) * _override.size();
+}
@@ -8,10 +8,20 @@
 	Reinventing bicycles since 2020
 */
 
+#include "../header/p6_async_simulation.hpp"
 #include "../header/p6_construction.hpp"
 #include "../header/p6_linear_material.hpp"
+#include "../header/p6_linear_solver.hpp"
+#include "../header/p6_monte_carlo.hpp"
 #include "../header/p6_nonlinear_material.hpp"
+#include "../header/p6_optimizer.hpp"
+#include "../header/p6_stick_kernel.hpp"
+#include "../header/p6_sweep.hpp"
+#include "../header/p6_trace.hpp"
 #include <gtest/gtest.h>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
 #include <limits>
 #include <cmath>
 
@@ -163,6 +173,830 @@ TEST(Construction, NonlinearCalculation)
 	EXPECT_NEAR(con.get_node_coord(2).y, 0.985997, 0.001);
 }
 
+//Creates rectangular lattice with fixed bottom row and loaded top row
+static void create_lattice(p6::Construction *con, p6::uint width, p6::uint height, bool nonlinear)
+{
+	for (p6::uint j = 0; j < height; j++)
+	{
+		for (p6::uint i = 0; i < width; i++)
+		{
+			p6::uint node = con->create_node();
+			con->set_node_coord(node, p6::Coord((p6::real)i, (p6::real)j));
+			con->set_node_freedom(node, (j == 0) ? 0 : ((i == 0) ? 1 : 2));
+			con->set_node_rail_vector(node, p6::Coord(0.0, 1.0));
+		}
+	}
+	if (nonlinear) con->create_nonlinear_material("goo", "s * 1000 + s * s * s * 10000");
+	else con->create_linear_material("steel", 1000.0);
+	for (p6::uint j = 0; j < height; j++)
+	{
+		for (p6::uint i = 0; i < width; i++)
+		{
+			p6::uint stick[2]; stick[0] = j * width + i;
+			p6::uint neighbors[4][2] = { { i + 1, j }, { i, j + 1 }, { i + 1, j + 1 }, { i - 1, j + 1 } };
+			for (p6::uint k = 0; k < 4; k++)
+			{
+				if (neighbors[k][0] >= width || neighbors[k][1] >= height) continue;
+				stick[1] = neighbors[k][1] * width + neighbors[k][0];
+				p6::uint created = con->create_stick(stick);
+				con->set_stick_material(created, 0);
+				con->set_stick_area(created, 1.0);
+			}
+		}
+	}
+	for (p6::uint i = 0; i < width; i++)
+	{
+		p6::uint force = con->create_force((height - 1) * width + i);
+		con->set_force_direction(force, p6::Coord(0.3, -1.0));
+	}
+}
+
+static void expect_same_coords(const p6::Construction &a, const p6::Construction &b, p6::real tolerance)
+{
+	ASSERT_EQ(a.get_node_count(), b.get_node_count());
+	for (p6::uint i = 0; i < a.get_node_count(); i++)
+	{
+		EXPECT_NEAR(a.get_node_coord(i).x, b.get_node_coord(i).x, tolerance);
+		EXPECT_NEAR(a.get_node_coord(i).y, b.get_node_coord(i).y, tolerance);
+	}
+}
+
+TEST(Construction, Report)
+{
+	p6::Construction con;
+	create_lattice(&con, 20, 10, true);
+	p6::uint calls = 0;
+	con.set_iteration_callback([&](const p6::Construction::SimulationIteration &iteration)
+	{
+		EXPECT_EQ(iteration.increment, con.get_report().increment_load.size() - 1);
+		calls++;
+	});
+	con.simulate(true);
+	const p6::Construction::SimulationReport &report = con.get_report();
+	EXPECT_TRUE(report.converged);
+	EXPECT_EQ(report.iteration.size(), calls);
+	EXPECT_GT(calls, 0u);
+	EXPECT_EQ(report.increment_load.back(), 1.0);
+	EXPECT_EQ(report.increment_converged.back(), 1);
+	EXPECT_LT(report.iteration.back().max_residual, report.tolerance);
+	EXPECT_GE(report.total_time, report.assembly_time + report.factorization_time + report.solve_time);
+	EXPECT_GT(report.nonzeros, 0u);
+	EXPECT_EQ(report.factor_nonzeros, report.nonzeros + report.fill_in);
+}
+
+TEST(Construction, SolverOptions)
+{
+	p6::Construction early, polished;
+	create_lattice(&early, 20, 10, true);
+	create_lattice(&polished, 20, 10, true);
+	p6::Construction::SolverOptions options = polished.get_solver_options();
+	options.early_exit = false;
+	polished.set_solver_options(options);
+	early.simulate(true);
+	polished.simulate(true);
+	EXPECT_LT(early.get_report().iteration.size(), polished.get_report().iteration.size());
+	EXPECT_LT(early.get_report().iteration.back().max_residual, early.get_report().tolerance);
+	expect_same_coords(early, polished, 0.001);
+
+	//Increments exceeding iteration limit are halved
+	options = early.get_solver_options();
+	options.max_iterations = 3;
+	early.set_solver_options(options);
+	try { early.simulate(true); } catch (...) {}
+	std::vector<p6::uint> iterations(early.get_report().increment_load.size(), 0);
+	for (p6::uint i = 0; i < early.get_report().iteration.size(); i++) iterations[early.get_report().iteration[i].increment]++;
+	for (p6::uint i = 0; i < iterations.size(); i++) EXPECT_LE(iterations[i], 3u);
+
+	//Report contains effective tolerance
+	options = polished.get_solver_options();
+	options.relative_tolerance = 0.01;
+	polished.set_solver_options(options);
+	polished.simulate(false);
+	polished.simulate(true);
+	EXPECT_DOUBLE_EQ(polished.get_report().tolerance, 0.01);
+	EXPECT_LT(polished.get_report().iteration.back().max_residual, 0.01);
+}
+
+TEST(Construction, QuasiNewton)
+{
+	const p6::Construction::Update updates[2] = { p6::Construction::Update::modified_newton, p6::Construction::Update::bfgs };
+	p6::Construction newton;
+	create_lattice(&newton, 20, 10, true);
+	newton.simulate(true);
+	for (p6::uint u = 0; u < 2; u++)
+	{
+		p6::Construction con;
+		create_lattice(&con, 20, 10, true);
+		p6::Construction::SolverOptions options = con.get_solver_options();
+		options.update = updates[u];
+		con.set_solver_options(options);
+		con.simulate(true);
+		const p6::Construction::SimulationReport &report = con.get_report();
+		p6::uint factorizations = 0;
+		for (p6::uint i = 0; i < report.iteration.size(); i++) factorizations += report.iteration[i].factorized ? 1 : 0;
+		EXPECT_LT(factorizations, report.iteration.size());
+		EXPECT_LT(report.iteration.back().max_residual, report.tolerance);
+		expect_same_coords(con, newton, 0.001);
+	}
+}
+
+TEST(Construction, TrustRegion)
+{
+	p6::Construction search, region;
+	create_lattice(&search, 20, 10, true);
+	create_lattice(&region, 20, 10, true);
+	p6::Construction::SolverOptions options = region.get_solver_options();
+	options.globalization = p6::Construction::Globalization::trust_region;
+	region.set_solver_options(options);
+	search.simulate(true);
+	region.simulate(true);
+	EXPECT_LT(region.get_report().iteration.back().max_residual, region.get_report().tolerance);
+	EXPECT_GT(region.get_report().iteration.back().radius, 0.0);
+	expect_same_coords(search, region, 0.001);
+
+	//Matrix-free mode applies derivative stick by stick
+	p6::Construction matrix_free;
+	create_lattice(&matrix_free, 20, 10, true);
+	matrix_free.set_solver(p6::Construction::Solver::cg);
+	matrix_free.set_matrix_free(true);
+	matrix_free.set_solver_options(options);
+	matrix_free.simulate(true);
+	expect_same_coords(search, matrix_free, 0.001);
+}
+
+TEST(Construction, ThreadCountIndependence)
+{
+	p6::Construction serial, parallel;
+	create_lattice(&serial, 40, 20, true);
+	create_lattice(&parallel, 40, 20, true);
+	parallel.set_thread_count(4);
+	serial.simulate(true);
+	parallel.simulate(true);
+	for (p6::uint i = 0; i < serial.get_node_count(); i++)
+	{
+		EXPECT_EQ(serial.get_node_coord(i).x, parallel.get_node_coord(i).x);
+		EXPECT_EQ(serial.get_node_coord(i).y, parallel.get_node_coord(i).y);
+	}
+}
+
+TEST(StickKernel, LevelIndependence)
+{
+	const p6::StickKernel::Level levels[2] = { p6::StickKernel::Level::avx2, p6::StickKernel::Level::avx512 };
+	const p6::StickKernel::Level level = p6::StickKernel::get_level();
+	const p6::StickKernel::Level supported = p6::StickKernel::get_supported_level();
+	p6::Construction scalar;
+	create_lattice(&scalar, 40, 20, false);
+	p6::StickKernel::set_level(p6::StickKernel::Level::scalar);
+	EXPECT_EQ(p6::StickKernel::get_level(), p6::StickKernel::Level::scalar);
+	scalar.simulate(true);
+	for (p6::uint l = 0; l < 2; l++)
+	{
+		//Levels are clamped to supported one
+		p6::Construction vector;
+		create_lattice(&vector, 40, 20, false);
+		p6::StickKernel::set_level(levels[l]);
+		EXPECT_EQ(p6::StickKernel::get_level(), (levels[l] < supported) ? levels[l] : supported);
+		vector.simulate(true);
+		for (p6::uint i = 0; i < scalar.get_node_count(); i++)
+		{
+			EXPECT_EQ(scalar.get_node_coord(i).x, vector.get_node_coord(i).x);
+			EXPECT_EQ(scalar.get_node_coord(i).y, vector.get_node_coord(i).y);
+		}
+	}
+	p6::StickKernel::set_level(level);
+}
+
+TEST(Construction, SymmetricSolvers)
+{
+	p6::Construction lu, ldlt, llt;
+	create_lattice(&lu, 20, 10, true);
+	create_lattice(&ldlt, 20, 10, true);
+	create_lattice(&llt, 20, 10, true);
+	ldlt.set_solver(p6::Construction::Solver::ldlt);
+	llt.set_solver(p6::Construction::Solver::llt);
+	lu.simulate(true);
+	ldlt.simulate(true);
+	llt.simulate(true);
+	expect_same_coords(lu, ldlt, 0.0001);
+	expect_same_coords(lu, llt, 0.0001);
+	EXPECT_LT(ldlt.get_report().factor_nonzeros, lu.get_report().factor_nonzeros);
+	EXPECT_EQ(llt.get_report().factor_nonzeros, ldlt.get_report().factor_nonzeros);
+}
+
+TEST(Construction, IterativeSolvers)
+{
+	p6::Construction direct;
+	create_lattice(&direct, 20, 10, true);
+	direct.simulate(true);
+	p6::Construction::Solver solvers[2] = { p6::Construction::Solver::cg, p6::Construction::Solver::minres };
+	p6::Construction::Preconditioner preconditioners[3] = { p6::Construction::Preconditioner::jacobi,
+		p6::Construction::Preconditioner::incomplete_cholesky, p6::Construction::Preconditioner::amg };
+	for (p6::uint s = 0; s < 2; s++)
+	{
+		for (p6::uint p = 0; p < 3; p++)
+		{
+			p6::Construction iterative;
+			create_lattice(&iterative, 20, 10, true);
+			iterative.set_solver(solvers[s]);
+			iterative.set_preconditioner(preconditioners[p]);
+			iterative.simulate(true);
+			expect_same_coords(direct, iterative, 0.0001);
+			EXPECT_EQ(iterative.get_report().factor_nonzeros, 0u);
+		}
+	}
+}
+
+TEST(Construction, MatrixFree)
+{
+	p6::Construction direct;
+	create_lattice(&direct, 20, 10, true);
+	direct.simulate(true);
+	p6::Construction::Solver solvers[2] = { p6::Construction::Solver::cg, p6::Construction::Solver::minres };
+	for (p6::uint s = 0; s < 2; s++)
+	{
+		p6::Construction matrix_free;
+		create_lattice(&matrix_free, 20, 10, true);
+		matrix_free.set_solver(solvers[s]);
+		matrix_free.set_matrix_free(true);
+		matrix_free.set_thread_count(4);
+		matrix_free.simulate(true);
+		expect_same_coords(direct, matrix_free, 0.0001);
+		EXPECT_EQ(matrix_free.get_report().nonzeros, 0u);
+	}
+}
+
+TEST(Construction, MixedPrecision)
+{
+	p6::Construction direct;
+	create_lattice(&direct, 20, 10, true);
+	direct.simulate(true);
+	p6::Construction::Solver solvers[3] = { p6::Construction::Solver::lu, p6::Construction::Solver::ldlt, p6::Construction::Solver::llt };
+	for (p6::uint s = 0; s < 3; s++)
+	{
+		p6::Construction mixed;
+		create_lattice(&mixed, 20, 10, true);
+		mixed.set_solver(solvers[s]);
+		mixed.set_mixed_precision(true);
+		mixed.simulate(true);
+		expect_same_coords(direct, mixed, 0.0001);
+		EXPECT_EQ(mixed.get_report().iteration.size(), direct.get_report().iteration.size()); //Refined solutions are as accurate as double precision ones
+	}
+}
+
+TEST(MixedPrecisionSolver, Refinement)
+{
+	//Well-conditioned matrix is refined to double precision
+	p6::TripletVector triplets;
+	const p6::uint size = 50;
+	for (p6::uint i = 0; i < size; i++)
+	{
+		triplets.push_back(Eigen::Triplet<p6::real>(i, i, 4.0));
+		if (i > 0) triplets.push_back(Eigen::Triplet<p6::real>(i, i - 1, -1.0));
+		if (i + 1 < size) triplets.push_back(Eigen::Triplet<p6::real>(i, i + 1, -1.0));
+	}
+	p6::SparseMatrix matrix(size, size);
+	matrix.setFromTriplets(triplets.begin(), triplets.end());
+	p6::DenseVector right(size), solution;
+	for (p6::uint i = 0; i < size; i++) right(i) = 1.0 + 0.1 * i;
+	p6::MixedLDLTSolver solver;
+	solver.analyze(matrix);
+	EXPECT_TRUE(solver.factorize(matrix));
+	solver.set_tolerance(0.5); //Forcing term of Newton's method does not loosen refinement
+	solver.solve(right, &solution);
+	EXPECT_FALSE(solver.get_fallback_used());
+	EXPECT_LE((right - matrix * solution).norm(), 1e-12 * right.norm());
+
+	//Matrix singular in single precision falls back to double precision
+	triplets.clear();
+	triplets.push_back(Eigen::Triplet<p6::real>(0, 0, 1.0));
+	triplets.push_back(Eigen::Triplet<p6::real>(0, 1, 1.0));
+	triplets.push_back(Eigen::Triplet<p6::real>(1, 0, 1.0));
+	triplets.push_back(Eigen::Triplet<p6::real>(1, 1, 1.0 + 1e-9));
+	p6::SparseMatrix singular(2, 2);
+	singular.setFromTriplets(triplets.begin(), triplets.end());
+	p6::DenseVector singular_right(2);
+	singular_right << 2.0, 2.0 + 1e-9;
+	p6::MixedLUSolver fallback;
+	fallback.analyze(singular);
+	EXPECT_TRUE(fallback.factorize(singular));
+	fallback.solve(singular_right, &solution);
+	EXPECT_TRUE(fallback.get_fallback_used());
+	EXPECT_NEAR(solution(0), 1.0, 1e-5);
+	EXPECT_NEAR(solution(1), 1.0, 1e-5);
+}
+
+TEST(Construction, Renumbering)
+{
+	p6::Construction natural, renumbered;
+	create_lattice(&natural, 20, 10, true);
+	create_lattice(&renumbered, 20, 10, true);
+	renumbered.set_renumbering(true);
+	natural.simulate(true);
+	renumbered.simulate(true);
+	expect_same_coords(natural, renumbered, 1e-9);
+	EXPECT_LT(renumbered.get_report().fill_in, natural.get_report().fill_in);
+	std::vector<p6::real> natural_area, renumbered_area;
+	std::vector<p6::Coord> natural_coord, renumbered_coord;
+	natural.get_sensitivity(p6::Construction::Response::compliance, 0, p6::Coord(), &natural_area, &natural_coord);
+	renumbered.get_sensitivity(p6::Construction::Response::compliance, 0, p6::Coord(), &renumbered_area, &renumbered_coord);
+	for (p6::uint i = 0; i < natural.get_stick_count(); i++) EXPECT_NEAR(natural_area[i], renumbered_area[i], 1e-9);
+}
+
+static void extend_lattice(p6::Construction *con, p6::uint width, p6::uint height)
+{
+	p6::uint node = con->create_node();
+	con->set_node_coord(node, p6::Coord(0.5, (p6::real)height));
+	con->set_node_freedom(node, 2);
+	for (p6::uint i = 0; i < 2; i++)
+	{
+		p6::uint stick[2] = { (height - 1) * width + i, node };
+		p6::uint created = con->create_stick(stick);
+		con->set_stick_material(created, 0);
+		con->set_stick_area(created, 1.0);
+	}
+	con->set_force_direction(0, p6::Coord(0.0, -2.0));
+}
+
+TEST(Construction, WarmStart)
+{
+	p6::Construction cold, warm;
+	create_lattice(&cold, 20, 10, true);
+	create_lattice(&warm, 20, 10, true);
+	for (p6::uint i = 0; i < cold.get_force_count(); i++)
+	{
+		//Heavy load, so that cold start needs several iterations
+		cold.set_force_direction(i, cold.get_force_direction(i) * 50.0);
+		warm.set_force_direction(i, warm.get_force_direction(i) * 50.0);
+	}
+	warm.simulate(true);
+	warm.simulate(false);
+	extend_lattice(&cold, 20, 10);
+	extend_lattice(&warm, 20, 10);
+	cold.set_warm_start(false);
+	cold.simulate(true);
+	warm.simulate(true);
+	expect_same_coords(cold, warm, 0.0001);
+	EXPECT_LT(warm.get_report().iteration.size(), cold.get_report().iteration.size());
+}
+
+TEST(Construction, LoadStepping)
+{
+	p6::Construction direct, stepped;
+	create_lattice(&direct, 20, 10, true);
+	create_lattice(&stepped, 20, 10, true);
+	p6::uint corner = stepped.get_node_count() - 1;
+	stepped.set_node_tracked(corner, true);
+	stepped.set_load_steps(4);
+	direct.simulate(true);
+	stepped.simulate(true);
+	expect_same_coords(direct, stepped, 0.0001);
+	ASSERT_GE(stepped.get_path_size(), 3);
+	EXPECT_EQ(stepped.get_path_load(0), 0.0);
+	EXPECT_EQ(stepped.get_path_load(stepped.get_path_size() - 1), 1.0);
+	for (p6::uint i = 1; i < stepped.get_path_size(); i++)
+	{
+		EXPECT_GT(stepped.get_path_load(i), stepped.get_path_load(i - 1));
+		EXPECT_LT(stepped.get_node_path(corner, i).y, stepped.get_node_path(corner, i - 1).y);
+	}
+	p6::Coord displacement = stepped.get_node_coord(corner) - p6::Coord(19.0, 9.0);
+	EXPECT_NEAR(stepped.get_node_path(corner, stepped.get_path_size() - 1).x, displacement.x, 1e-9);
+	EXPECT_NEAR(stepped.get_node_path(corner, stepped.get_path_size() - 1).y, displacement.y, 1e-9);
+}
+
+TEST(Construction, LoadCases)
+{
+	p6::Construction con;
+	create_lattice(&con, 20, 10, true);
+	con.set_thread_count(2);
+	std::vector<std::vector<p6::Construction::Force>> cases(3);
+	for (p6::uint i = 0; i < con.get_force_count(); i++)
+	{
+		p6::Construction::Force force;
+		force.node = con.get_force_node(i);
+		force.direction = con.get_force_direction(i);
+		cases[0].push_back(force);
+		force.direction = force.direction * -0.5;
+		cases[1].push_back(force);
+	}
+	p6::Construction::LoadCaseResult result;
+	con.simulate_load_cases(cases, &result);
+
+	for (p6::uint c = 0; c < cases.size(); c++)
+	{
+		ASSERT_TRUE(result.converged[c]);
+		p6::Construction single;
+		create_lattice(&single, 20, 10, true);
+		for (p6::uint i = 0; i < single.get_force_count(); i++)
+		{
+			single.set_force_direction(i, (c < 2) ? cases[c][i].direction : p6::Coord(0.0, 0.0));
+		}
+		single.simulate(true);
+		for (p6::uint i = 0; i < single.get_node_count(); i++)
+		{
+			p6::Coord displacement = result.displacement[c * single.get_node_count() + i];
+			EXPECT_NEAR(single.get_node_coord(i).x - con.get_node_coord(i).x, displacement.x, 0.0001);
+			EXPECT_NEAR(single.get_node_coord(i).y - con.get_node_coord(i).y, displacement.y, 0.0001);
+			EXPECT_LE(result.min_displacement[i].y, displacement.y);
+			EXPECT_GE(result.max_displacement[i].y, displacement.y);
+		}
+		for (p6::uint i = 0; i < single.get_stick_count(); i++)
+		{
+			p6::real force = (c < 2) ? single.get_stick_force(i) : 0.0;
+			EXPECT_NEAR(force, result.force[c * single.get_stick_count() + i], 0.001);
+			EXPECT_LE(result.min_force[i], force + 0.001);
+			EXPECT_GE(result.max_force[i], force - 0.001);
+		}
+	}
+}
+
+static p6::real get_response(const p6::Construction *con, p6::Construction::Response response, p6::uint index, p6::Coord direction)
+{
+	if (response == p6::Construction::Response::stick_force) return con->get_stick_force(index);
+	p6::Construction original(*con);
+	original.simulate(false);
+	if (response == p6::Construction::Response::node_displacement) return direction.dot(con->get_node_coord(index) - original.get_node_coord(index));
+	p6::real compliance = 0.0;
+	for (p6::uint i = 0; i < con->get_force_count(); i++)
+	{
+		p6::uint node = con->get_force_node(i);
+		compliance += con->get_force_direction(i).dot(con->get_node_coord(node) - original.get_node_coord(node));
+	}
+	return compliance;
+}
+
+TEST(Construction, Sensitivity)
+{
+	const p6::Construction::Response responses[3] = { p6::Construction::Response::compliance, p6::Construction::Response::node_displacement, p6::Construction::Response::stick_force };
+	const p6::uint width = 4, height = 3, nodes[3] = { 1, width, width + 2 }, stick = 15;
+	const p6::uint index[3] = { 0, 2 * width + 1, 5 };
+	const p6::Coord direction(0.6, 0.8);
+	const p6::real step = 1e-5;
+	const p6::Construction::Update updates[2] = { p6::Construction::Update::newton, p6::Construction::Update::modified_newton };
+	for (p6::uint u = 0; u < 2; u++)
+	{
+		p6::Construction con;
+		create_lattice(&con, width, height, true);
+
+		//Central differences need states converged beyond tolerance, kept factorization has to belong to converged state
+		p6::Construction::SolverOptions options = con.get_solver_options();
+		options.early_exit = false;
+		options.step_tolerance = 1e-12;
+		options.update = updates[u];
+		con.set_solver_options(options);
+		con.simulate(true);
+		for (p6::uint r = 0; r < 3; r++)
+		{
+			std::vector<p6::real> area;
+			std::vector<p6::Coord> coord;
+			con.get_sensitivity(responses[r], index[r], direction, &area, &coord);
+			ASSERT_EQ(area.size(), con.get_stick_count());
+			ASSERT_EQ(coord.size(), con.get_node_count());
+
+			//Factorization is not copied, copy creates it's own
+			std::vector<p6::real> copy_area;
+			std::vector<p6::Coord> copy_coord;
+			p6::Construction copy(con);
+			copy.get_sensitivity(responses[r], index[r], direction, &copy_area, &copy_coord);
+			EXPECT_NEAR(area[stick], copy_area[stick], 1e-9);
+			EXPECT_NEAR(coord[nodes[2]].x, copy_coord[nodes[2]].x, 1e-9);
+
+			//Central differences
+			p6::real value[2];
+			for (p6::uint j = 0; j < 2; j++)
+			{
+				p6::Construction perturbed(con);
+				perturbed.simulate(false);
+				perturbed.set_stick_area(stick, perturbed.get_stick_area(stick) + ((j == 0) ? -step : step));
+				perturbed.simulate(true);
+				value[j] = get_response(&perturbed, responses[r], index[r], direction);
+			}
+			p6::real difference = (value[1] - value[0]) / (2 * step);
+			EXPECT_NEAR(area[stick], difference, 1e-3 * std::abs(difference) + 1e-8);
+			for (p6::uint n = 0; n < 3; n++)
+			{
+				for (p6::uint j = 0; j < 2; j++)
+				{
+					p6::Construction perturbed(con);
+					perturbed.simulate(false);
+					perturbed.set_node_coord(nodes[n], perturbed.get_node_coord(nodes[n]) + p6::Coord((j == 0) ? -step : step, 0.0));
+					perturbed.simulate(true);
+					value[j] = get_response(&perturbed, responses[r], index[r], direction);
+				}
+				difference = (value[1] - value[0]) / (2 * step);
+				EXPECT_NEAR(coord[nodes[n]].x, difference, 1e-3 * std::abs(difference) + 1e-8);
+			}
+		}
+	}
+}
+
+static void create_ground(p6::Construction *con, p6::uint width, p6::uint height)
+{
+	for (p6::uint j = 0; j < height; j++)
+	{
+		for (p6::uint i = 0; i < width; i++)
+		{
+			p6::uint node = con->create_node();
+			con->set_node_coord(node, p6::Coord((p6::real)i, (p6::real)j));
+			con->set_node_freedom(node, (i == 0) ? 0 : 2);
+		}
+	}
+	con->create_linear_material("steel", 100000.0);
+	p6::uint force = con->create_force((height / 2) * width + width - 1);
+	con->set_force_direction(force, p6::Coord(0.0, -1.0));
+}
+
+TEST(AsyncSimulation, Converged)
+{
+	p6::Construction con, reference;
+	create_lattice(&con, 20, 10, true);
+	create_lattice(&reference, 20, 10, true);
+	reference.simulate(true);
+	std::unique_ptr<p6::AsyncSimulation> simulation = con.simulate_async();
+	simulation->wait();
+	EXPECT_EQ(simulation->get_status(), p6::AsyncSimulation::Status::converged);
+	EXPECT_EQ(simulation->get_progress().iteration, con.get_report().iteration.size());
+	EXPECT_LT(simulation->get_progress().max_residual, simulation->get_progress().tolerance);
+	EXPECT_TRUE(con.get_simulation());
+	for (p6::uint i = 0; i < con.get_node_count(); i++)
+	{
+		EXPECT_EQ(con.get_node_coord(i).x, reference.get_node_coord(i).x);
+		EXPECT_EQ(con.get_node_coord(i).y, reference.get_node_coord(i).y);
+	}
+}
+
+TEST(AsyncSimulation, Cancel)
+{
+	//Cancellation requested from first iteration stops simulation, construction stays editable
+	p6::Construction con;
+	create_lattice(&con, 20, 10, true);
+	std::atomic<p6::AsyncSimulation*> handle(nullptr);
+	con.set_iteration_callback([&](const p6::Construction::SimulationIteration &) { while (handle == nullptr) {} handle.load()->cancel(); });
+	std::unique_ptr<p6::AsyncSimulation> simulation = con.simulate_async();
+	handle = simulation.get();
+	simulation->wait();
+	EXPECT_EQ(simulation->get_status(), p6::AsyncSimulation::Status::cancelled);
+	EXPECT_EQ(con.get_report().iteration.size(), 1u);
+	EXPECT_FALSE(con.get_simulation());
+	EXPECT_EQ(con.get_node_coord(con.get_node_count() - 1).x, 19.0);
+	con.set_iteration_callback(std::function<void(const p6::Construction::SimulationIteration &)>());
+	con.simulate(true);
+	EXPECT_TRUE(con.get_simulation());
+
+	//Passed deadline stops simulation
+	p6::Construction late;
+	create_lattice(&late, 20, 10, true);
+	simulation = late.simulate_async(1e-9);
+	EXPECT_TRUE(simulation->wait_for(60.0));
+	EXPECT_EQ(simulation->get_status(), p6::AsyncSimulation::Status::timed_out);
+	EXPECT_FALSE(late.get_simulation());
+}
+
+TEST(Optimizer, Generate)
+{
+	p6::Construction con;
+	create_ground(&con, 9, 5);
+	p6::Optimizer optimizer(&con);
+	optimizer.set_max_length(2.3);
+	p6::uint expected = 0;
+	for (p6::uint i = 0; i < con.get_node_count(); i++)
+	{
+		for (p6::uint j = i + 1; j < con.get_node_count(); j++)
+		{
+			if (con.get_node_freedom(i) == 0 && con.get_node_freedom(j) == 0) continue;
+			if (con.get_node_coord(i).distance(con.get_node_coord(j)) <= 2.3) expected++;
+		}
+	}
+	EXPECT_EQ(optimizer.generate(), expected);
+	EXPECT_EQ(con.get_stick_count(), expected);
+	EXPECT_EQ(optimizer.generate(), 0);
+}
+
+TEST(Optimizer, Compliance)
+{
+	p6::Construction con, uniform;
+	create_ground(&con, 9, 5);
+	p6::Optimizer optimizer(&con);
+	optimizer.set_max_length(2.3);
+	optimizer.set_initial_area(0.1);
+	optimizer.generate();
+	uniform = con;
+	p6::uint candidates = con.get_stick_count();
+	p6::real volume = 0.0;
+	for (p6::uint i = 0; i < candidates; i++) volume += con.get_stick_area(i) * con.get_stick_length(i);
+	optimizer.set_volume_limit(0.5 * volume);
+	optimizer.optimize();
+	EXPECT_LT(con.get_stick_count(), candidates / 2);
+	EXPECT_NEAR(optimizer.get_volume(), 0.5 * volume, 0.01 * volume);
+
+	//Optimized construction is stiffer than uniform one with the same volume
+	for (p6::uint i = 0; i < candidates; i++) uniform.set_stick_area(i, 0.05);
+	uniform.simulate(true);
+	con.simulate(true);
+	p6::uint node = con.get_force_node(0);
+	p6::real uniform_compliance = -(uniform.get_node_coord(node).y - 2.0);
+	p6::real compliance = -(con.get_node_coord(node).y - 2.0);
+	EXPECT_LT(compliance, 0.5 * uniform_compliance);
+}
+
+TEST(Optimizer, StressLimit)
+{
+	p6::Construction con;
+	create_ground(&con, 9, 5);
+	p6::Optimizer optimizer(&con);
+	optimizer.set_max_length(2.3);
+	optimizer.set_initial_area(0.1);
+	optimizer.set_stress_limit(10.0);
+	optimizer.set_volume_limit(5.0);
+	optimizer.generate();
+	optimizer.optimize();
+	con.simulate(true);
+
+	//Limit is not applied to vanishing sticks
+	p6::real thickest = 0.0;
+	for (p6::uint i = 0; i < con.get_stick_count(); i++) thickest = std::max(thickest, con.get_stick_area(i));
+	for (p6::uint i = 0; i < con.get_stick_count(); i++)
+	{
+		if (con.get_stick_area(i) < 0.01 * thickest) continue;
+		EXPECT_LT(std::abs(con.get_stick_force(i)) / con.get_stick_area(i), 10.0 * 1.05);
+	}
+}
+
+TEST(Trace, Spans)
+{
+	p6::Construction con;
+	create_lattice(&con, 20, 10, false);
+	p6::Trace::enable(true);
+	con.simulate(true);
+	p6::Trace::disable();
+	EXPECT_FALSE(p6::Trace::enabled());
+	if (p6::Trace::compiled())
+	{
+		EXPECT_GT(p6::Trace::get_span_count(), 0u);
+		p6::Trace::write("p6_test_trace.json");
+		std::ifstream file("p6_test_trace.json");
+		std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		EXPECT_NE(text.find("\"name\":\"fill_derivative_and_residual\""), std::string::npos);
+		EXPECT_NE(text.find("\"name\":\"line_search\""), std::string::npos);
+		file.close();
+		std::remove("p6_test_trace.json");
+	}
+	else EXPECT_EQ(p6::Trace::get_span_count(), 0u);
+}
+
+TEST(Sweep, Variants)
+{
+	p6::Construction base;
+	create_lattice(&base, 10, 5, true);
+	base.set_thread_count(4);
+	p6::Sweep sweep(&base);
+	sweep.create_variant();
+	sweep.set_stick_area(sweep.create_variant(), 3, 2.0);
+	sweep.set_material_modulus(sweep.create_variant(), 0, 2000.0);
+	sweep.set_material_formula(sweep.create_variant(), 0, "s * 2000");
+	sweep.set_node_coord(sweep.create_variant(), 45, p6::Coord(5.2, 4.3));
+	sweep.set_force_magnitude(sweep.create_variant(), 2, 0.5);
+	sweep.set_material_formula(sweep.create_variant(), 0, "0.1 * sin(s)"); //Sticks are too weak to carry forces
+	sweep.simulate();
+
+	std::vector<p6::Construction> variants(6);
+	for (p6::uint v = 0; v < variants.size(); v++) create_lattice(&variants[v], 10, 5, true);
+	variants[1].set_stick_area(3, 2.0);
+	variants[2].create_linear_material("goo", 2000.0);
+	variants[3].create_nonlinear_material("goo", "s * 2000");
+	variants[4].set_node_coord(45, p6::Coord(5.2, 4.3));
+	variants[5].set_force_direction(2, variants[5].get_force_direction(2) * (0.5 / variants[5].get_force_direction(2).norm()));
+	for (p6::uint v = 0; v < variants.size(); v++)
+	{
+		ASSERT_TRUE(sweep.get_converged(v));
+		std::vector<p6::Coord> initial(variants[v].get_node_count());
+		for (p6::uint i = 0; i < initial.size(); i++) initial[i] = variants[v].get_node_coord(i);
+		variants[v].simulate(true);
+		for (p6::uint i = 0; i < initial.size(); i++)
+		{
+			EXPECT_NEAR(variants[v].get_node_coord(i).x - initial[i].x, sweep.get_node_displacement(i, 0)[v], 0.0001);
+			EXPECT_NEAR(variants[v].get_node_coord(i).y - initial[i].y, sweep.get_node_displacement(i, 1)[v], 0.0001);
+		}
+		for (p6::uint i = 0; i < variants[v].get_stick_count(); i++)
+		{
+			EXPECT_NEAR(variants[v].get_stick_force(i), sweep.get_stick_force(i)[v], 0.001);
+		}
+	}
+	EXPECT_FALSE(sweep.get_converged(6));
+	EXPECT_TRUE(sweep.get_stick_force(0)[6] != sweep.get_stick_force(0)[6]);
+
+	//Errors other than non-convergence are not hidden as unconverged variants
+	p6::Sweep invalid_sweep(&base);
+	invalid_sweep.create_variant();
+	invalid_sweep.set_material_formula(invalid_sweep.create_variant(), 0, "s *");
+	EXPECT_THROW(invalid_sweep.simulate(), std::runtime_error);
+}
+
+TEST(Sweep, SimulatedBase)
+{
+	p6::Construction base, simulated;
+	create_lattice(&base, 10, 5, true);
+	create_lattice(&simulated, 10, 5, true);
+	simulated.simulate(true);
+	p6::Sweep sweep(&base), simulated_sweep(&simulated);
+	p6::Sweep *sweeps[2] = { &sweep, &simulated_sweep };
+	for (p6::uint s = 0; s < 2; s++)
+	{
+		sweeps[s]->set_stick_area(sweeps[s]->create_variant(), 3, 2.0);
+		sweeps[s]->set_force_magnitude(sweeps[s]->create_variant(), 2, 0.5);
+		sweeps[s]->simulate();
+	}
+	for (p6::uint v = 0; v < 2; v++)
+	{
+		ASSERT_TRUE(simulated_sweep.get_converged(v));
+		EXPECT_GT(std::abs(simulated_sweep.get_node_displacement(45, 1)[v]), 0.001);
+		for (p6::uint i = 0; i < base.get_node_count(); i++)
+		{
+			EXPECT_NEAR(sweep.get_node_displacement(i, 0)[v], simulated_sweep.get_node_displacement(i, 0)[v], 0.0001);
+			EXPECT_NEAR(sweep.get_node_displacement(i, 1)[v], simulated_sweep.get_node_displacement(i, 1)[v], 0.0001);
+		}
+		for (p6::uint i = 0; i < base.get_stick_count(); i++)
+		{
+			EXPECT_NEAR(sweep.get_stick_force(i)[v], simulated_sweep.get_stick_force(i)[v], 0.001);
+		}
+	}
+
+	//Force without direction can not be scaled
+	base.set_force_direction(2, p6::Coord(0.0, 0.0));
+	p6::Sweep zero_sweep(&base);
+	zero_sweep.set_force_magnitude(zero_sweep.create_variant(), 2, 0.5);
+	EXPECT_THROW(zero_sweep.simulate(), std::runtime_error);
+}
+
+TEST(MonteCarlo, Statistics)
+{
+	p6::Construction con;
+	create_lattice(&con, 10, 5, false);
+	p6::MonteCarlo serial(&con), parallel(&con);
+	p6::MonteCarlo *monte_carlo[2] = { &serial, &parallel };
+	for (p6::uint m = 0; m < 2; m++)
+	{
+		monte_carlo[m]->set_seed(42);
+		monte_carlo[m]->set_sample_count(300);
+		for (p6::uint i = 0; i < con.get_force_count(); i++) monte_carlo[m]->set_force_deviation(i, 0.1);
+		for (p6::uint i = 0; i < con.get_stick_count(); i++) monte_carlo[m]->set_stick_area_deviation(i, 0.05);
+		monte_carlo[m]->add_quantile(0.05);
+		monte_carlo[m]->add_quantile(0.5);
+		monte_carlo[m]->add_quantile(0.95);
+	}
+	p6::Construction deterministic(con);
+	deterministic.simulate(true);
+	p6::uint stick = 0;
+	for (p6::uint i = 0; i < con.get_stick_count(); i++)
+	{
+		if (std::abs(deterministic.get_stick_force(i)) > std::abs(deterministic.get_stick_force(stick))) stick = i;
+	}
+	serial.set_stick_force_limit(stick, std::abs(deterministic.get_stick_force(stick)));
+	parallel.set_stick_force_limit(stick, std::abs(deterministic.get_stick_force(stick)));
+	serial.simulate();
+	con.set_thread_count(4);
+	parallel.simulate();
+
+	EXPECT_EQ(serial.get_converged_count(), 300);
+	EXPECT_NEAR(serial.get_stick_force_mean(stick), deterministic.get_stick_force(stick), 0.05 * std::abs(deterministic.get_stick_force(stick)));
+	EXPECT_GT(serial.get_stick_force_variance(stick), 0.0);
+	EXPECT_LT(serial.get_stick_force_quantile(stick, 0), serial.get_stick_force_quantile(stick, 1));
+	EXPECT_LT(serial.get_stick_force_quantile(stick, 1), serial.get_stick_force_quantile(stick, 2));
+	EXPECT_GT(serial.get_stick_failure_probability(stick), 0.3);
+	EXPECT_LT(serial.get_stick_failure_probability(stick), 0.7);
+	EXPECT_EQ(serial.get_failure_probability(), serial.get_stick_failure_probability(stick));
+	for (p6::uint i = 0; i < con.get_node_count(); i++)
+	{
+		EXPECT_EQ(serial.get_node_displacement_mean(i).y, parallel.get_node_displacement_mean(i).y);
+		EXPECT_EQ(serial.get_node_displacement_variance(i).y, parallel.get_node_displacement_variance(i).y);
+		EXPECT_EQ(serial.get_node_displacement_quantile(i, 2).y, parallel.get_node_displacement_quantile(i, 2).y);
+	}
+}
+
+TEST(MonteCarlo, SimulatedBase)
+{
+	p6::Construction base, simulated;
+	create_lattice(&base, 10, 5, false);
+	create_lattice(&simulated, 10, 5, false);
+	simulated.simulate(true);
+	p6::MonteCarlo monte_carlo(&base), simulated_monte_carlo(&simulated);
+	p6::MonteCarlo *monte_carlos[2] = { &monte_carlo, &simulated_monte_carlo };
+	for (p6::uint m = 0; m < 2; m++)
+	{
+		monte_carlos[m]->set_seed(42);
+		monte_carlos[m]->set_sample_count(50);
+		for (p6::uint i = 0; i < base.get_force_count(); i++) monte_carlos[m]->set_force_deviation(i, 0.1);
+		monte_carlos[m]->set_node_displacement_limit(45, 0.5);
+		monte_carlos[m]->simulate();
+	}
+	EXPECT_GT(std::abs(simulated_monte_carlo.get_node_displacement_mean(45).y), 0.001);
+	EXPECT_EQ(monte_carlo.get_node_failure_probability(45), simulated_monte_carlo.get_node_failure_probability(45));
+	for (p6::uint i = 0; i < base.get_node_count(); i++)
+	{
+		EXPECT_NEAR(monte_carlo.get_node_displacement_mean(i).x, simulated_monte_carlo.get_node_displacement_mean(i).x, 0.0001);
+		EXPECT_NEAR(monte_carlo.get_node_displacement_mean(i).y, simulated_monte_carlo.get_node_displacement_mean(i).y, 0.0001);
+	}
+}
+
 int main(int argc, char **argv)
 {
 	::testing::InitGoogleTest(&argc, argv);
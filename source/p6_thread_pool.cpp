@@ -0,0 +1,85 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#include "../header/p6_thread_pool.hpp"
+
+p6::ThreadPool::ThreadPool(uint threads) : _next(0)
+{
+	if (threads == 0) threads = std::thread::hardware_concurrency();
+	for (uint i = 1; i < threads; i++) _thread.push_back(std::thread(&ThreadPool::_work, this));
+}
+
+void p6::ThreadPool::_execute() noexcept
+{
+	while (true)
+	{
+		uint index = _next++;
+		if (index >= _count) break;
+		(*_task)(index);
+	}
+}
+
+void p6::ThreadPool::_work() noexcept
+{
+	uint generation = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_start.wait(lock, [&]{ return _exit || _generation != generation; });
+			if (_exit) return;
+			generation = _generation;
+		}
+		_execute();
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_running--;
+		}
+		_finish.notify_one();
+	}
+}
+
+p6::uint p6::ThreadPool::thread_count() const noexcept
+{
+	return _thread.size() + 1;
+}
+
+void p6::ThreadPool::run(uint count, const std::function<void(uint)> &task) noexcept
+{
+	if (_thread.empty() || count <= 1)
+	{
+		for (uint i = 0; i < count; i++) task(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_task = &task;
+		_count = count;
+		_next = 0;
+		_running = _thread.size();
+		_generation++;
+	}
+	_start.notify_all();
+	_execute();
+	std::unique_lock<std::mutex> lock(_mutex);
+	_finish.wait(lock, [&]{ return _running == 0; });
+	_task = nullptr;
+}
+
+p6::ThreadPool::~ThreadPool() noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_exit = true;
+	}
+	_start.notify_all();
+	for (uint i = 0; i < _thread.size(); i++) _thread[i].join();
+}
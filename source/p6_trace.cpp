@@ -0,0 +1,159 @@
+/*
+	This software is distributed under MIT License, which means:
+		- Do whatever you want
+		- Please keep this notice and include the license file to your project
+		- I provide no warranty
+
+	Created by Kyrylo Sovailo (github.com/Meta-chan, k.sovailo@gmail.com)
+	Reinventing bicycles since 2020
+*/
+
+#include "../header/p6_trace.hpp"
+#include "../header/p6_file.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#ifdef __linux__
+	#include <linux/perf_event.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+std::mutex p6::Trace::_mutex;
+std::vector<p6::Trace::Span> p6::Trace::_span;
+std::vector<std::thread::id> p6::Trace::_thread;
+std::chrono::steady_clock::time_point p6::Trace::_origin;
+std::atomic<bool> p6::Trace::_enabled(false);
+std::atomic<bool> p6::Trace::_counters(false);
+
+p6::Trace::Scope::Scope(const char *name) noexcept : _name(name), _active(_enabled.load(std::memory_order_relaxed))
+{
+	if (!_active) return;
+	if (!_counters.load(std::memory_order_relaxed) || !_read_counters(_counter)) _counter[0] = UINT64_MAX;
+	_begin = std::chrono::steady_clock::now();
+}
+
+p6::Trace::Scope::~Scope() noexcept
+{
+	if (!_active) return;
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	std::uint64_t counter[counter_count];
+	const bool counted = _counter[0] != UINT64_MAX && _read_counters(counter);
+	if (counted) for (uint i = 0; i < counter_count; i++) counter[i] -= _counter[i];
+	_record(_name, _begin, end, counted ? counter : nullptr);
+}
+
+bool p6::Trace::_read_counters(std::uint64_t counter[counter_count]) noexcept
+{
+	#ifdef __linux__
+		//Counters are opened once per thread and count user-space events of the thread
+		struct Counters
+		{
+			int fd[counter_count];
+			Counters() noexcept
+			{
+				const std::uint64_t config[counter_count] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+				for (uint i = 0; i < counter_count; i++)
+				{
+					perf_event_attr attribute;
+					memset(&attribute, 0, sizeof(attribute));
+					attribute.type = PERF_TYPE_HARDWARE;
+					attribute.size = sizeof(attribute);
+					attribute.config = config[i];
+					attribute.exclude_kernel = 1;
+					attribute.exclude_hv = 1;
+					fd[i] = (int)syscall(__NR_perf_event_open, &attribute, 0, -1, -1, 0);
+				}
+			}
+			~Counters() noexcept
+			{
+				for (uint i = 0; i < counter_count; i++) if (fd[i] >= 0) close(fd[i]);
+			}
+		};
+		static thread_local Counters counters;
+		for (uint i = 0; i < counter_count; i++)
+		{
+			if (counters.fd[i] < 0 || read(counters.fd[i], &counter[i], sizeof(std::uint64_t)) != sizeof(std::uint64_t)) return false;
+		}
+		return true;
+	#else
+		return false;
+	#endif
+}
+
+void p6::Trace::_record(const char *name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end, const std::uint64_t *counter) noexcept
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	Span span;
+	span.name = name;
+	span.begin = std::chrono::duration<real, std::micro>(begin - _origin).count();
+	span.duration = std::chrono::duration<real, std::micro>(end - begin).count();
+	std::thread::id id = std::this_thread::get_id();
+	span.thread = std::find(_thread.begin(), _thread.end(), id) - _thread.begin();
+	if (span.thread == _thread.size()) _thread.push_back(id);
+	span.counted = counter != nullptr;
+	for (uint i = 0; i < counter_count; i++) span.counter[i] = span.counted ? counter[i] : 0;
+	try { _span.push_back(span); } catch (...) {}
+}
+
+bool p6::Trace::compiled() noexcept
+{
+	#ifdef P6_TRACE_ENABLED
+		return true;
+	#else
+		return false;
+	#endif
+}
+
+void p6::Trace::enable(bool counters)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_span.clear();
+	_thread.clear();
+	_origin = std::chrono::steady_clock::now();
+	_counters = counters;
+	_enabled = true;
+}
+
+void p6::Trace::disable() noexcept
+{
+	_enabled = false;
+}
+
+bool p6::Trace::enabled() noexcept
+{
+	return _enabled;
+}
+
+p6::uint p6::Trace::get_span_count() noexcept
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _span.size();
+}
+
+void p6::Trace::write(const String filepath)
+{
+	//Spans are complete events ("ph":"X") with microsecond timestamps, counters are event arguments
+	std::lock_guard<std::mutex> lock(_mutex);
+	OutputFile file(filepath);
+	if (!file.ok()) throw std::runtime_error("File cannot be opened for write");
+	String text = "{\"traceEvents\":[";
+	for (uint i = 0; i < _span.size(); i++)
+	{
+		const Span &span = _span[i];
+		char buffer[512];
+		snprintf(buffer, sizeof(buffer), "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+			(i == 0) ? "" : ",", span.name, (unsigned int)span.thread, span.begin, span.duration);
+		text += buffer;
+		if (span.counted)
+		{
+			snprintf(buffer, sizeof(buffer), ",\"args\":{\"cycles\":%llu,\"cache_misses\":%llu,\"branch_misses\":%llu}",
+				(unsigned long long)span.counter[0], (unsigned long long)span.counter[1], (unsigned long long)span.counter[2]);
+			text += buffer;
+		}
+		text += "}";
+	}
+	text += "\n],\"displayTimeUnit\":\"ms\"}\n";
+	file.write(text.data(), text.size());
+}